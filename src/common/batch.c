@@ -0,0 +1,464 @@
+/* batch.c - Batched screen output
+ *
+ * This file is part of Frotz.
+ *
+ * Frotz is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Frotz is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The screen module sends all of its display calls through the
+ * functions below. Unless an interface has registered a sink with
+ * batch_set_sink, they go straight to the os_ functions. Otherwise
+ * they are recorded as a list of events (text runs, cursor moves,
+ * erases and scrolls), each carrying the text attributes and window
+ * that were in effect, and handed to the sink in one go whenever the
+ * interpreter is about to wait for the player, show a more prompt, or
+ * stop. The event list and the text arena are reused between batches.
+ *
+ * An interface that has no use for the screen contents can have them
+ * discarded altogether with batch_discard. The screen module still
+ * keeps track of cursors and windows, so what the game sees does not
+ * change.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "frotz.h"
+
+static batch_sink_t sink = NULL;
+
+static bool discard = FALSE;
+
+static batch_event_t *events = NULL;
+static int event_count = 0;
+static int event_space = 0;
+
+static zchar *text = NULL;
+static long text_length = 0;
+static long text_space = 0;
+
+/* Text attributes as recorded, and as last passed to the interface */
+
+static int style = 0;
+static int font = TEXT_FONT;
+static int foreground = DEFAULT_COLOUR;
+static int background = DEFAULT_COLOUR;
+
+static int applied_style = -1;
+static int applied_font = -1;
+static int applied_foreground = -1;
+static int applied_background = -1;
+
+
+/*
+ * batch_set_sink
+ *
+ * Start (or, given NULL, stop) batching screen output. Anything still
+ * pending is delivered to the old sink first.
+ *
+ */
+void batch_set_sink (batch_sink_t new_sink)
+{
+    batch_flush ();
+
+    sink = new_sink;
+
+}/* batch_set_sink */
+
+
+/*
+ * new_event
+ *
+ * Append an event of the given type to the current batch.
+ *
+ */
+static batch_event_t *new_event (int type)
+{
+    batch_event_t *e;
+
+    if (event_count == event_space) {
+
+	event_space = event_space ? 2 * event_space : 256;
+
+	if ((e = realloc (events, event_space * sizeof (batch_event_t))) == NULL)
+	    os_fatal ("Out of memory");
+
+	events = e;
+
+    }
+
+    e = events + event_count++;
+
+    e->type = type;
+    e->window = cwin;
+    e->style = style;
+    e->font = font;
+    e->foreground = foreground;
+    e->background = background;
+    e->text = 0;
+    e->length = 0;
+
+    return e;
+
+}/* new_event */
+
+
+/*
+ * add_text
+ *
+ * Append characters to the text arena, extending the last event if it
+ * is a text run with the same attributes.
+ *
+ */
+static void add_text (const zchar *s, int length)
+{
+    batch_event_t *e = NULL;
+    zchar *t;
+
+    if (length == 0)
+	return;
+
+    if (text_length + length + 1 > text_space) {
+
+	while (text_length + length + 1 > text_space)
+	    text_space = text_space ? 2 * text_space : 1024;
+
+	if ((t = realloc (text, text_space * sizeof (zchar))) == NULL)
+	    os_fatal ("Out of memory");
+
+	text = t;
+
+    }
+
+    if (event_count != 0)
+	e = events + event_count - 1;
+
+    if (e == NULL || e->type != BATCH_TEXT
+	|| e->window != cwin || e->style != style || e->font != font
+	|| e->foreground != foreground || e->background != background) {
+
+	e = new_event (BATCH_TEXT);
+	e->text = text_length;
+
+    } else text_length--;	/* overwrite the terminating zero */
+
+    memcpy (text + text_length, s, length * sizeof (zchar));
+
+    text_length += length;
+    e->length += length;
+
+    text[text_length++] = 0;
+
+}/* add_text */
+
+
+/*
+ * batch_display_char
+ *
+ */
+void batch_display_char (zchar c)
+{
+    if (discard)
+	return;
+
+    if (sink == NULL)
+	{ os_display_char (c); return; }
+
+    add_text (&c, 1);
+
+}/* batch_display_char */
+
+
+/*
+ * batch_display_string
+ *
+ * Record a string, turning embedded font and style changes into
+ * attributes of the text runs.
+ *
+ */
+void batch_display_string (const zchar *s)
+{
+    const zchar *run;
+
+    if (discard)
+	return;
+
+    if (sink == NULL)
+	{ os_display_string (s); return; }
+
+    for (run = s; *s != 0; s++)
+
+	if (*s == ZC_NEW_FONT || *s == ZC_NEW_STYLE) {
+
+	    add_text (run, s - run);
+
+	    if (*s == ZC_NEW_FONT)
+		font = *++s;
+	    else
+		style = *++s;
+
+	    run = s + 1;
+
+	}
+
+    add_text (run, s - run);
+
+}/* batch_display_string */
+
+
+/*
+ * batch_set_cursor
+ *
+ */
+void batch_set_cursor (int row, int col)
+{
+    batch_event_t *e;
+
+    if (discard)
+	return;
+
+    if (sink == NULL)
+	{ os_set_cursor (row, col); return; }
+
+    /* Only the last of several cursor moves in a row matters */
+
+    if (event_count != 0 && events[event_count - 1].type == BATCH_CURSOR)
+	event_count--;
+
+    e = new_event (BATCH_CURSOR);
+    e->top = row;
+    e->left = col;
+
+}/* batch_set_cursor */
+
+
+/*
+ * batch_erase_area
+ *
+ */
+void batch_erase_area (int top, int left, int bottom, int right, int win)
+{
+    batch_event_t *e;
+
+    if (discard)
+	return;
+
+    if (sink == NULL)
+	{ os_erase_area (top, left, bottom, right, win); return; }
+
+    e = new_event (BATCH_ERASE);
+    e->top = top;
+    e->left = left;
+    e->bottom = bottom;
+    e->right = right;
+    e->units = win;
+
+}/* batch_erase_area */
+
+
+/*
+ * batch_scroll_area
+ *
+ */
+void batch_scroll_area (int top, int left, int bottom, int right, int units)
+{
+    batch_event_t *e;
+
+    if (discard)
+	return;
+
+    if (sink == NULL)
+	{ os_scroll_area (top, left, bottom, right, units); return; }
+
+    e = new_event (BATCH_SCROLL);
+    e->top = top;
+    e->left = left;
+    e->bottom = bottom;
+    e->right = right;
+    e->units = units;
+
+}/* batch_scroll_area */
+
+
+/*
+ * batch_set_text_style
+ *
+ */
+void batch_set_text_style (int new_style)
+{
+    if (sink == NULL)
+	os_set_text_style (new_style);
+    else
+	style = new_style;
+
+}/* batch_set_text_style */
+
+
+/*
+ * batch_set_font
+ *
+ */
+void batch_set_font (int new_font)
+{
+    if (sink == NULL)
+	os_set_font (new_font);
+    else
+	font = new_font;
+
+}/* batch_set_font */
+
+
+/*
+ * batch_set_colour
+ *
+ */
+void batch_set_colour (int new_foreground, int new_background)
+{
+    if (sink == NULL)
+	os_set_colour (new_foreground, new_background);
+    else {
+	foreground = new_foreground;
+	background = new_background;
+    }
+
+}/* batch_set_colour */
+
+
+/*
+ * apply_attributes
+ *
+ * Pass text attributes on to the interface where they have changed.
+ *
+ */
+static void apply_attributes (int new_style, int new_font,
+			      int new_foreground, int new_background)
+{
+    if (new_foreground != applied_foreground || new_background != applied_background) {
+	os_set_colour (new_foreground, new_background);
+	applied_foreground = new_foreground;
+	applied_background = new_background;
+    }
+
+    if (new_font != applied_font) {
+	os_set_font (new_font);
+	applied_font = new_font;
+    }
+
+    if (new_style != applied_style) {
+	os_set_text_style (new_style);
+	applied_style = new_style;
+    }
+
+}/* apply_attributes */
+
+
+/*
+ * batch_replay
+ *
+ * Perform a list of events through the usual os_ functions. This is
+ * what a sink calls if all it wants is fewer, larger display calls.
+ *
+ */
+void batch_replay (const batch_event_t *list, int count, const zchar *strings)
+{
+    const batch_event_t *e;
+
+    for (e = list; e < list + count; e++) {
+
+	apply_attributes (e->style, e->font, e->foreground, e->background);
+
+	switch (e->type) {
+	case BATCH_TEXT:
+	    os_display_string (strings + e->text);
+	    break;
+	case BATCH_CURSOR:
+	    os_set_cursor (e->top, e->left);
+	    break;
+	case BATCH_ERASE:
+	    os_erase_area (e->top, e->left, e->bottom, e->right, e->units);
+	    break;
+	case BATCH_SCROLL:
+	    os_scroll_area (e->top, e->left, e->bottom, e->right, e->units);
+	    break;
+	}
+
+    }
+
+    /* Leave the interface with the attributes now in effect, so that
+       input is echoed correctly */
+
+    apply_attributes (style, font, foreground, background);
+
+}/* batch_replay */
+
+
+/*
+ * batch_flush
+ *
+ * Hand all pending events to the sink.
+ *
+ */
+void batch_flush (void)
+{
+    static bool locked = FALSE;
+
+    if (sink == NULL || locked)
+	return;
+
+    /* The sink may end up here again, e.g. through os_fatal */
+
+    locked = TRUE;
+
+    sink (events, event_count, text);
+
+    event_count = 0;
+    text_length = 0;
+
+    locked = FALSE;
+
+}/* batch_flush */
+
+
+/*
+ * batch_discard
+ *
+ * Start (or stop) throwing screen output away. Text attributes are
+ * still passed on.
+ *
+ */
+void batch_discard (bool on)
+{
+    batch_flush ();
+
+    discard = on;
+
+}/* batch_discard */
+
+
+/*
+ * batch_reset
+ *
+ * Forget what the interface was told about text attributes, e.g. after
+ * it has reset them itself.
+ *
+ */
+void batch_reset (void)
+{
+    applied_style = -1;
+    applied_font = -1;
+    applied_foreground = -1;
+    applied_background = -1;
+
+}/* batch_reset */
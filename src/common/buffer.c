@@ -18,6 +18,7 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdlib.h>
 #include <string.h>
 #include "frotz.h"
 
@@ -25,7 +26,11 @@ extern void stream_char (zchar);
 extern void stream_word (const zchar *);
 extern void stream_new_line (void);
 
-static zchar buffer[TEXT_BUFFER_SIZE];
+/* The buffer starts at TEXT_BUFFER_SIZE characters and grows as needed,
+   so that long unbroken strings (URLs, ASCII art) fit in one piece. */
+
+static zchar *buffer = NULL;
+static int bufsize = 0;
 static int bufpos = 0;
 
 static zchar prev_c = 0;
@@ -66,6 +71,29 @@ void flush_buffer (void)
 
 }/* flush_buffer */
 
+/*
+ * grow_buffer
+ *
+ * Make room for more characters in the text buffer. Returns FALSE if
+ * there is no memory left.
+ *
+ */
+static bool grow_buffer (void)
+{
+    zchar *p;
+    int size = bufsize ? 2 * bufsize : TEXT_BUFFER_SIZE;
+
+    if ((p = realloc (buffer, size * sizeof (zchar))) == NULL)
+	return FALSE;
+
+    buffer = p;
+    bufsize = size;
+
+    return TRUE;
+
+}/* grow_buffer */
+
+
 /*
  * print_char
  *
@@ -103,12 +131,15 @@ void print_char (zchar c)
 
 	} else flag = FALSE;
 
-	/* Insert the character into the buffer */
-
-	buffer[bufpos++] = c;
+	/* Insert the character into the buffer, keeping room for the
+	   terminating zero */
 
-	if (bufpos == TEXT_BUFFER_SIZE)
+	if (bufpos + 1 >= bufsize && !grow_buffer ()) {
 	    runtime_error (ERR_TEXT_BUF_OVF);
+	    flush_buffer ();
+	}
+
+	buffer[bufpos++] = c;
 
     } else stream_char (c);
 
@@ -136,7 +167,10 @@ void new_line (void)
  */
 void init_buffer(void)
 {
-    memset(buffer, 0, sizeof (zchar) * TEXT_BUFFER_SIZE);
+    if (buffer == NULL && !grow_buffer ())
+	os_fatal ("Out of memory");
+
+    memset(buffer, 0, sizeof (zchar) * bufsize);
     bufpos = 0;
     prev_c = 0;
 }
@@ -0,0 +1,1063 @@
+/* codemap.c - Routine map built from the story file at load time
+ *
+ * This file is part of Frotz.
+ *
+ * Frotz is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Frotz is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * When f_setup.code_map is set, the story file is decoded once it has
+ * been loaded. Starting from the main routine, every instruction that
+ * control can flow to is decoded, and every call to a constant address
+ * adds a routine to be decoded in turn. Routines that are only called
+ * through variables are looked for in the tables below high memory: a
+ * word that unpacks to a plausible routine header in high memory is
+ * decoded as well, but the result only counts if the whole routine
+ * decodes cleanly without running into code already known, since these
+ * words may just as well be data.
+ *
+ * The result is a list of routines, sorted by address, and a bitmap
+ * with one bit for each byte of the story file that starts an
+ * instruction. Code that cannot be decoded, e.g. an illegal opcode or
+ * a branch out of the story file, makes the story unplayable and
+ * stops the interpreter before the game starts.
+ *
+ * The map is cached in a file next to the story, keyed by the release
+ * number, serial number and checksum of the story.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frotz.h"
+
+#define CODE_MAP_MAGIC "FZCM"
+#define CODE_MAP_FORMAT 1
+
+/* What an opcode does besides taking its operands */
+
+#define I_STORE OPCODE_STORE
+#define I_BRANCH OPCODE_BRANCH
+#define I_TEXT 0x04			/* followed by an inline string */
+#define I_STOP 0x08			/* never falls through */
+#define I_CALL 0x10			/* first operand is a routine */
+#define I_JUMP 0x20
+#define I_ILLEGAL 0x40
+
+static const zbyte op0_info[0x10] = {
+    I_STOP,				/* rtrue */
+    I_STOP,				/* rfalse */
+    I_TEXT,				/* print */
+    I_TEXT | I_STOP,			/* print_ret */
+    0,					/* nop */
+    0,					/* save, see decode */
+    0,					/* restore, see decode */
+    I_STOP,				/* restart */
+    I_STOP,				/* ret_popped */
+    0,					/* pop or catch, see decode */
+    I_STOP,				/* quit */
+    0,					/* new_line */
+    0,					/* show_status */
+    I_BRANCH,				/* verify */
+    0,					/* extended */
+    I_BRANCH				/* piracy */
+};
+
+static const zbyte op1_info[0x10] = {
+    I_BRANCH,				/* jz */
+    I_STORE | I_BRANCH,			/* get_sibling */
+    I_STORE | I_BRANCH,			/* get_child */
+    I_STORE,				/* get_parent */
+    I_STORE,				/* get_prop_len */
+    0,					/* inc */
+    0,					/* dec */
+    0,					/* print_addr */
+    I_STORE | I_CALL,			/* call_1s */
+    0,					/* remove_obj */
+    0,					/* print_obj */
+    I_STOP,				/* ret */
+    I_JUMP | I_STOP,			/* jump */
+    0,					/* print_paddr */
+    I_STORE,				/* load */
+    0					/* not or call_1n, see decode */
+};
+
+static const zbyte op2_info[0x20] = {
+    I_ILLEGAL,
+    I_BRANCH,				/* je */
+    I_BRANCH,				/* jl */
+    I_BRANCH,				/* jg */
+    I_BRANCH,				/* dec_chk */
+    I_BRANCH,				/* inc_chk */
+    I_BRANCH,				/* jin */
+    I_BRANCH,				/* test */
+    I_STORE,				/* or */
+    I_STORE,				/* and */
+    I_BRANCH,				/* test_attr */
+    0,					/* set_attr */
+    0,					/* clear_attr */
+    0,					/* store */
+    0,					/* insert_obj */
+    I_STORE,				/* loadw */
+    I_STORE,				/* loadb */
+    I_STORE,				/* get_prop */
+    I_STORE,				/* get_prop_addr */
+    I_STORE,				/* get_next_prop */
+    I_STORE,				/* add */
+    I_STORE,				/* sub */
+    I_STORE,				/* mul */
+    I_STORE,				/* div */
+    I_STORE,				/* mod */
+    I_STORE | I_CALL,			/* call_2s */
+    I_CALL,				/* call_2n */
+    0,					/* set_colour */
+    I_STOP,				/* throw */
+    I_ILLEGAL,
+    I_ILLEGAL,
+    I_ILLEGAL
+};
+
+static const zbyte var_info[0x20] = {
+    I_STORE | I_CALL,			/* call_vs */
+    0,					/* storew */
+    0,					/* storeb */
+    0,					/* put_prop */
+    0,					/* read, see decode */
+    0,					/* print_char */
+    0,					/* print_num */
+    I_STORE,				/* random */
+    0,					/* push */
+    0,					/* pull, see decode */
+    0,					/* split_window */
+    0,					/* set_window */
+    I_STORE | I_CALL,			/* call_vs2 */
+    0,					/* erase_window */
+    0,					/* erase_line */
+    0,					/* set_cursor */
+    0,					/* get_cursor */
+    0,					/* set_text_style */
+    0,					/* buffer_mode */
+    0,					/* output_stream */
+    0,					/* input_stream */
+    0,					/* sound_effect */
+    I_STORE,				/* read_char */
+    I_STORE | I_BRANCH,			/* scan_table */
+    I_STORE,				/* not */
+    I_CALL,				/* call_vn */
+    I_CALL,				/* call_vn2 */
+    0,					/* tokenise */
+    0,					/* encode_text */
+    0,					/* copy_table */
+    0,					/* print_table */
+    I_BRANCH				/* check_arg_count */
+};
+
+static const zbyte ext_info[0x1d] = {
+    I_STORE,				/* save */
+    I_STORE,				/* restore */
+    I_STORE,				/* log_shift */
+    I_STORE,				/* art_shift */
+    I_STORE,				/* set_font */
+    0,					/* draw_picture */
+    I_BRANCH,				/* picture_data */
+    0,					/* erase_picture */
+    0,					/* set_margins */
+    I_STORE,				/* save_undo */
+    I_STORE,				/* restore_undo */
+    0,					/* print_unicode */
+    I_STORE,				/* check_unicode */
+    I_ILLEGAL,
+    I_ILLEGAL,
+    I_ILLEGAL,
+    0,					/* move_window */
+    0,					/* window_size */
+    0,					/* window_style */
+    I_STORE,				/* get_wind_prop */
+    0,					/* scroll_window */
+    0,					/* pop_stack */
+    0,					/* read_mouse */
+    0,					/* mouse_window */
+    I_BRANCH,				/* push_stack */
+    0,					/* put_wind_prop */
+    0,					/* print_form */
+    I_BRANCH,				/* make_menu */
+    0					/* picture_table */
+};
+
+/* A decoded instruction */
+
+typedef struct {
+    long next;				/* address of the next instruction */
+    long target;			/* branch or jump target, or -1 */
+    long callee;			/* routine called, or -1 */
+    bool stop;
+} insn_t;
+
+/* A routine waiting to be decoded */
+
+typedef struct {
+    long addr;
+    zbyte flags;
+} pending_t;
+
+routine_t *routines = NULL;
+long routine_count = 0;
+zbyte *code_map = NULL;
+
+static long routine_space = 0;
+
+static pending_t *queue = NULL;		/* routines to decode */
+static long queue_count = 0;
+static long queue_space = 0;
+
+static long *todo = NULL;		/* addresses within a routine */
+static long todo_count = 0;
+static long todo_space = 0;
+
+static long *done = NULL;		/* instructions of the routine */
+static long done_count = 0;
+static long done_space = 0;
+
+static zbyte *headers = NULL;		/* routines already queued */
+static zbyte *inside = NULL;		/* bytes within routines found */
+
+static long bad_addr = -1;		/* first instruction that failed */
+
+#define MARK(map,addr) ((map)[(addr) >> 3] |= 1 << ((addr) & 7))
+#define UNMARK(map,addr) ((map)[(addr) >> 3] &= ~(1 << ((addr) & 7)))
+#define MARKED(map,addr) ((map)[(addr) >> 3] & (1 << ((addr) & 7)))
+
+
+/*
+ * grow
+ *
+ * Make room for one more element in a growing array.
+ *
+ */
+static void *grow (void *array, long *space, long count, size_t size)
+{
+    if (count < *space)
+	return array;
+
+    *space = (*space == 0) ? 64 : 2 * *space;
+
+    if ((array = realloc (array, *space * size)) == NULL)
+	os_fatal ("Out of memory");
+
+    return array;
+
+}/* grow */
+
+
+/*
+ * unpack_routine
+ *
+ * Return the byte address of a packed routine address.
+ *
+ */
+static long unpack_routine (zword packed)
+{
+    if (h_version <= V3)
+	return (long) packed << 1;
+    else if (h_version <= V5)
+	return (long) packed << 2;
+    else if (h_version <= V7)
+	return ((long) packed << 2) + ((long) h_functions_offset << 3);
+    else /* h_version == V8 */
+	return (long) packed << 3;
+
+}/* unpack_routine */
+
+
+/*
+ * opcode_info
+ *
+ * Return what the opcode does besides taking its operands. The number
+ * of an extended opcode follows 0xbe.
+ *
+ */
+zbyte opcode_info (zbyte opcode, zbyte ext)
+{
+    zbyte number;
+
+    if (opcode < 0x80)				/* 2OP opcodes */
+	return op2_info[opcode & 0x1f];
+
+    if (opcode < 0xb0) {			/* 1OP opcodes */
+	number = opcode & 0x0f;
+	if (number == 0x0f)
+	    return (h_version <= V4) ? I_STORE : I_CALL;
+	return op1_info[number];
+    }
+
+    if (opcode == 0xbe)				/* EXT opcodes */
+	return (ext < 0x1d) ? ext_info[ext] : 0;
+
+    if (opcode < 0xc0) {			/* 0OP opcodes */
+	number = opcode - 0xb0;
+	if (number == 0x05 || number == 0x06)
+	    return (h_version <= V3) ? I_BRANCH : I_STORE;
+	if (number == 0x09 && h_version >= V5)
+	    return I_STORE;
+	return op0_info[number];
+    }
+
+    if (opcode == 0xe4 && h_version >= V5)	/* VAR opcodes */
+	return I_STORE;
+    if (opcode == 0xe9 && h_version == V6)
+	return I_STORE;
+
+    return (opcode < 0xe0) ? op2_info[opcode & 0x1f] : var_info[opcode & 0x1f];
+
+}/* opcode_info */
+
+
+/*
+ * decode_operands
+ *
+ * Skip the operands given by a type byte, keeping the first one if it
+ * is a constant. Return the address after the operands, or -1 if they
+ * run past the end of the story file.
+ *
+ */
+static long decode_operands (long addr, zbyte types, long *first, bool *have_first)
+{
+    int shift;
+
+    for (shift = 6; shift >= 0; shift -= 2) {
+
+	int type = (types >> shift) & 3;
+
+	if (type == 3)
+	    break;
+
+	if (addr + ((type == 0) ? 2 : 1) > story_size)
+	    return -1;
+
+	if (!*have_first) {
+	    if (type == 0)
+		*first = (zmp[addr] << 8) | zmp[addr + 1];
+	    else if (type == 1)
+		*first = zmp[addr];
+	    *have_first = TRUE;
+	}
+
+	addr += (type == 0) ? 2 : 1;
+
+    }
+
+    return addr;
+
+}/* decode_operands */
+
+
+/*
+ * decode
+ *
+ * Decode the instruction at addr. Return FALSE if it is illegal or
+ * runs past the end of the story file.
+ *
+ */
+static bool decode (long addr, insn_t *insn)
+{
+    zbyte opcode;
+    zbyte info;
+    long first = -1;
+    bool have_first = FALSE;
+
+    insn->target = -1;
+    insn->callee = -1;
+
+    opcode = zmp[addr++];
+
+    if (opcode < 0x80) {			/* 2OP opcodes */
+
+	if (addr + 2 > story_size)
+	    return FALSE;
+
+	first = (opcode & 0x40) ? -1 : zmp[addr];
+	have_first = TRUE;
+	addr += 2;
+
+	info = opcode_info (opcode, 0);
+
+    } else if (opcode < 0xb0) {		/* 1OP opcodes */
+
+	int type = (opcode >> 4) & 3;
+
+	if (addr + ((type == 0) ? 2 : 1) > story_size)
+	    return FALSE;
+
+	if (type == 0)
+	    first = (zmp[addr] << 8) | zmp[addr + 1];
+	else if (type == 1)
+	    first = zmp[addr];
+	have_first = TRUE;
+	addr += (type == 0) ? 2 : 1;
+
+	info = opcode_info (opcode, 0);
+
+    } else if (opcode == 0xbe) {		/* EXT opcodes */
+
+	if (addr + 2 > story_size)
+	    return FALSE;
+
+	info = opcode_info (opcode, zmp[addr++]);
+	addr = decode_operands (addr + 1, zmp[addr], &first, &have_first);
+
+    } else if (opcode < 0xc0) {		/* 0OP opcodes */
+
+	info = opcode_info (opcode, 0);
+
+    } else {					/* VAR opcodes */
+
+	zbyte types1;
+	zbyte types2 = 0xff;
+
+	if (addr + 2 > story_size)
+	    return FALSE;
+
+	types1 = zmp[addr++];
+	if (opcode == 0xec || opcode == 0xfa)
+	    types2 = zmp[addr++];
+
+	addr = decode_operands (addr, types1, &first, &have_first);
+	if (addr >= 0)
+	    addr = decode_operands (addr, types2, &first, &have_first);
+
+	info = opcode_info (opcode, 0);
+
+    }
+
+    if (addr < 0 || (info & I_ILLEGAL))
+	return FALSE;
+
+    if (info & I_STORE)
+	addr++;
+
+    if (info & I_BRANCH) {
+
+	zbyte specifier;
+	long offset;
+
+	if (addr >= story_size)
+	    return FALSE;
+
+	specifier = zmp[addr++];
+
+	if (specifier & 0x40)
+	    offset = specifier & 0x3f;
+	else {
+	    if (addr >= story_size)
+		return FALSE;
+	    offset = ((specifier & 0x3f) << 8) | zmp[addr++];
+	    if (offset & 0x2000)
+		offset -= 0x4000;
+	}
+
+	if (offset > 1 || offset < 0) {
+	    insn->target = addr + offset - 2;
+	    if (insn->target < 0)
+		return FALSE;
+	}
+
+    }
+
+    if (info & I_TEXT) {
+
+	do {
+	    if (addr + 2 > story_size)
+		return FALSE;
+	    addr += 2;
+	} while (!(zmp[addr - 2] & 0x80));
+
+    }
+
+    if ((info & I_JUMP) && first >= 0) {
+	insn->target = addr + (short) first - 2;
+	if (insn->target < 0)
+	    return FALSE;
+    }
+
+    if ((info & I_CALL) && first > 0)
+	insn->callee = unpack_routine ((zword) first);
+
+    if (addr > story_size
+	|| insn->target >= story_size || insn->callee >= story_size)
+	return FALSE;
+
+    insn->next = addr;
+    insn->stop = (info & I_STOP) != 0;
+
+    return TRUE;
+
+}/* decode */
+
+
+/*
+ * enqueue
+ *
+ * Remember to decode the routine at addr, unless it is known already.
+ *
+ */
+static void enqueue (long addr, zbyte flags)
+{
+    if (MARKED (headers, addr))
+	return;
+
+    MARK (headers, addr);
+
+    queue = grow (queue, &queue_space, queue_count, sizeof (pending_t));
+    queue[queue_count].addr = addr;
+    queue[queue_count].flags = flags;
+    queue_count++;
+
+}/* enqueue */
+
+
+/*
+ * walk
+ *
+ * Decode every instruction of a routine that control can reach and add
+ * it to the map. The main routine of V1-5 and V7-8 games has no header;
+ * it is walked from start instead. Return FALSE and leave the map as it
+ * was if any instruction cannot be decoded.
+ *
+ */
+static bool walk (long start, zbyte flags)
+{
+    routine_t r;
+    long callees;
+    long i;
+
+    r.start = start;
+    r.flags = flags;
+
+    if ((flags & ROUTINE_MAIN) && h_version != V6) {
+	r.locals = 0;
+	r.entry = start;
+    } else {
+	if (start >= story_size || zmp[start] > 15)
+	    goto no_routine;
+	r.locals = zmp[start];
+	r.entry = start + 1 + ((h_version <= V4) ? 2 * r.locals : 0);
+    }
+
+    r.end = r.entry;
+
+    if (r.entry >= story_size
+	|| ((flags & ROUTINE_TABLE) && MARKED (inside, start)))
+	goto no_routine;
+
+    todo_count = 0;
+    done_count = 0;
+    callees = queue_count;
+
+    todo = grow (todo, &todo_space, todo_count, sizeof (long));
+    todo[todo_count++] = r.entry;
+
+    while (todo_count != 0) {
+
+	long addr = todo[--todo_count];
+	insn_t insn;
+
+	/* Falling through the last byte of the story file is as bad as
+	   an instruction that cannot be decoded */
+
+	if (addr < story_size && MARKED (code_map, addr))
+	    continue;
+
+	/* A routine found in a table that runs into known code is
+	   more likely data that happens to decode */
+
+	if (addr >= story_size || !decode (addr, &insn)
+	    || ((flags & ROUTINE_TABLE) && MARKED (inside, addr))) {
+
+	    /* Take back what this routine added */
+
+	    for (i = 0; i < done_count; i++)
+		UNMARK (code_map, done[i]);
+	    for (i = callees; i < queue_count; i++)
+		UNMARK (headers, queue[i].addr);
+	    queue_count = callees;
+
+	    if (bad_addr < 0 && !(flags & ROUTINE_TABLE))
+		bad_addr = addr;
+
+	    return FALSE;
+	}
+
+	MARK (code_map, addr);
+
+	done = grow (done, &done_space, done_count, sizeof (long));
+	done[done_count++] = addr;
+
+	if (addr < h_dynamic_size)
+	    r.flags |= ROUTINE_DYNAMIC;
+	if (insn.next > r.end)
+	    r.end = insn.next;
+
+	todo = grow (todo, &todo_space, todo_count + 2, sizeof (long));
+
+	if (!insn.stop)
+	    todo[todo_count++] = insn.next;
+	if (insn.target >= 0)
+	    todo[todo_count++] = insn.target;
+
+	if (insn.callee > 0)
+	    enqueue (insn.callee, ROUTINE_CALLED | (flags & ROUTINE_TABLE));
+
+    }
+
+    for (i = r.start; i < r.end; i++)
+	MARK (inside, i);
+
+    routines = grow (routines, &routine_space, routine_count, sizeof (routine_t));
+    routines[routine_count++] = r;
+
+    return TRUE;
+
+no_routine:
+
+    /* Without a main routine there is no game to play */
+
+    if (bad_addr < 0 && (flags & ROUTINE_MAIN))
+	bad_addr = start;
+
+    return FALSE;
+
+}/* walk */
+
+
+/*
+ * walk_queue
+ *
+ * Decode the routines queued so far and those they call.
+ *
+ */
+static void walk_queue (void)
+{
+    long i;
+
+    for (i = 0; i < queue_count; i++)
+	walk (queue[i].addr, queue[i].flags);
+
+    queue_count = 0;
+
+}/* walk_queue */
+
+
+/*
+ * candidate
+ *
+ * Queue the routine a word from a table might point to.
+ *
+ */
+static void candidate (zword packed)
+{
+    long addr;
+
+    if (packed == 0)
+	return;
+
+    addr = unpack_routine (packed);
+
+    if (addr >= h_resident_size && addr < story_size && zmp[addr] <= 15)
+	enqueue (addr, ROUTINE_TABLE);
+
+}/* candidate */
+
+
+/*
+ * scan_tables
+ *
+ * Look for routine addresses among the globals, the arrays and the
+ * property values of all objects.
+ *
+ */
+static void scan_tables (void)
+{
+    long objects;
+    long lowest;
+    long obj;
+    long addr;
+    int i;
+
+    for (i = 0; i < 240; i++) {
+	addr = h_globals + 2 * i;
+	if (addr + 2 <= h_dynamic_size)
+	    candidate ((zmp[addr] << 8) | zmp[addr + 1]);
+    }
+
+    /* Arrays may hold routines too, but their layout is unknown, so
+       try every word at an even address below high memory */
+
+    for (addr = 64; addr + 2 <= h_resident_size && addr + 2 <= story_size; addr += 2)
+	candidate ((zmp[addr] << 8) | zmp[addr + 1]);
+
+    /* The object table ends where the first property table starts */
+
+    objects = h_objects + ((h_version <= V3) ? 62 : 126);
+    lowest = h_dynamic_size;
+
+    for (obj = objects; obj < lowest; obj += (h_version <= V3) ? 9 : 14) {
+
+	long prop;
+	long entry = obj + ((h_version <= V3) ? 7 : 12);
+
+	if (entry + 2 > h_dynamic_size)
+	    break;
+
+	prop = (zmp[entry] << 8) | zmp[entry + 1];
+
+	if (prop >= h_dynamic_size)
+	    break;
+	if (prop < lowest)
+	    lowest = prop;
+
+	prop += 1 + 2 * zmp[prop];
+
+	while (prop < h_dynamic_size && zmp[prop] != 0) {
+
+	    zbyte size = zmp[prop++];
+	    int len;
+
+	    if (h_version <= V3)
+		len = (size >> 5) + 1;
+	    else if (!(size & 0x80))
+		len = (size >> 6) + 1;
+	    else {
+		if (prop >= h_dynamic_size)
+		    break;
+		len = zmp[prop++] & 0x3f;
+		if (len == 0)
+		    len = 64;
+	    }
+
+	    for (i = 0; i + 1 < len && prop + i + 1 < h_dynamic_size; i += 2)
+		candidate ((zmp[prop + i] << 8) | zmp[prop + i + 1]);
+
+	    prop += len;
+	}
+    }
+
+}/* scan_tables */
+
+
+/*
+ * by_start
+ *
+ * Order routines by address for qsort.
+ *
+ */
+static int by_start (const void *a, const void *b)
+{
+    long sa = ((const routine_t *) a)->start;
+    long sb = ((const routine_t *) b)->start;
+
+    return (sa > sb) - (sa < sb);
+
+}/* by_start */
+
+
+/*
+ * map_file_name
+ *
+ * Return the name of the file the map of this story is cached in.
+ *
+ */
+static char *map_file_name (void)
+{
+    char *name;
+
+    if (f_setup.story_file == NULL)
+	return NULL;
+
+    name = malloc (strlen (f_setup.story_file) + strlen (EXT_CODE_MAP) + 1);
+
+    if (name != NULL) {
+	strcpy (name, f_setup.story_file);
+	strcat (name, EXT_CODE_MAP);
+    }
+
+    return name;
+
+}/* map_file_name */
+
+
+/*
+ * put_long, get_long
+ *
+ * Write and read four byte numbers in the map file, high byte first.
+ *
+ */
+static void put_long (FILE *fp, long value)
+{
+    putc ((int) (value >> 24) & 0xff, fp);
+    putc ((int) (value >> 16) & 0xff, fp);
+    putc ((int) (value >> 8) & 0xff, fp);
+    putc ((int) value & 0xff, fp);
+
+}/* put_long */
+
+static long get_long (FILE *fp)
+{
+    long value = 0;
+    int i;
+
+    for (i = 0; i < 4; i++)
+	value = (value << 8) | (getc (fp) & 0xff);
+
+    return value;
+
+}/* get_long */
+
+
+/*
+ * write_map, read_map
+ *
+ * Save the map next to the story, and load it back if it belongs to
+ * the same release, serial number and checksum. The header records
+ * the story size as well, which fixes the size of the bitmap.
+ *
+ */
+static void write_map (const char *name)
+{
+    FILE *fp;
+    long i;
+
+    if ((fp = fopen (name, "wb")) == NULL)
+	return;
+
+    fputs (CODE_MAP_MAGIC, fp);
+    putc (CODE_MAP_FORMAT, fp);
+    putc (h_release >> 8, fp);
+    putc (h_release & 0xff, fp);
+    fwrite (h_serial, 1, 6, fp);
+    putc (h_checksum >> 8, fp);
+    putc (h_checksum & 0xff, fp);
+    put_long (fp, story_size);
+    put_long (fp, routine_count);
+
+    for (i = 0; i < routine_count; i++) {
+	put_long (fp, routines[i].start);
+	put_long (fp, routines[i].end);
+	putc (routines[i].locals, fp);
+	putc (routines[i].flags, fp);
+    }
+
+    fwrite (code_map, 1, (story_size + 7) / 8, fp);
+
+    if (fclose (fp) != 0)
+	remove (name);
+
+}/* write_map */
+
+static bool read_map (const char *name)
+{
+    FILE *fp;
+    zbyte header[15];
+    long count;
+    long i;
+
+    if ((fp = fopen (name, "rb")) == NULL)
+	return FALSE;
+
+    if (fread (header, 1, sizeof header, fp) != sizeof header
+	|| memcmp (header, CODE_MAP_MAGIC, 4) != 0
+	|| header[4] != CODE_MAP_FORMAT
+	|| ((header[5] << 8) | header[6]) != h_release
+	|| memcmp (header + 7, h_serial, 6) != 0
+	|| ((header[13] << 8) | header[14]) != h_checksum
+	|| get_long (fp) != story_size)
+	goto failed;
+
+    count = get_long (fp);
+
+    if (count <= 0 || count > story_size)
+	goto failed;
+
+    if ((routines = malloc (count * sizeof (routine_t))) == NULL)
+	goto failed;
+
+    for (i = 0; i < count; i++) {
+
+	routine_t *r = routines + i;
+
+	r->start = get_long (fp);
+	r->end = get_long (fp);
+	r->locals = getc (fp);
+	r->flags = getc (fp);
+
+	if ((r->flags & ROUTINE_MAIN) && h_version != V6)
+	    r->entry = r->start;
+	else
+	    r->entry = r->start + 1 + ((h_version <= V4) ? 2 * r->locals : 0);
+
+	if (r->start < 0 || r->end > story_size || r->entry > r->end
+	    || r->locals > 15)
+	    goto failed;
+    }
+
+    if (fread (code_map, 1, (story_size + 7) / 8, fp) != (story_size + 7) / 8)
+	goto failed;
+
+    fclose (fp);
+
+    routine_count = count;
+    routine_space = count;
+
+    return TRUE;
+
+failed:
+
+    fclose (fp);
+
+    free (routines);
+    routines = NULL;
+
+    return FALSE;
+
+}/* read_map */
+
+
+/*
+ * find_routine
+ *
+ * Return the routine that the instruction at pc belongs to, or NULL
+ * if it is not in the map.
+ *
+ */
+routine_t *find_routine (long pc)
+{
+    long lo = 0;
+    long hi = routine_count;
+
+    /* Find the last routine starting at or before pc */
+
+    while (lo < hi) {
+
+	long mid = (lo + hi) / 2;
+
+	if (routines[mid].start <= pc)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+
+    }
+
+    if (lo == 0 || pc >= routines[lo - 1].end)
+	return NULL;
+
+    return routines + lo - 1;
+
+}/* find_routine */
+
+
+/*
+ * init_code_map
+ *
+ * Build the routine map, or load it from the cache. Called once the
+ * story file is loaded.
+ *
+ */
+void init_code_map (void)
+{
+    char *name;
+    long start;
+
+    if (!f_setup.code_map)
+	return;
+
+    code_map = calloc ((story_size + 7) / 8, 1);
+    headers = calloc ((story_size + 7) / 8, 1);
+    inside = calloc ((story_size + 7) / 8, 1);
+
+    if (code_map == NULL || headers == NULL || inside == NULL)
+	os_fatal ("Out of memory");
+
+    name = map_file_name ();
+
+    if (name == NULL || !read_map (name)) {
+
+	memset (code_map, 0, (story_size + 7) / 8);
+
+	start = (h_version == V6) ? unpack_routine (h_start_pc) : h_start_pc;
+
+	if (start >= story_size)
+	    bad_addr = start;
+	else if (h_version == V6)
+	    enqueue (start, ROUTINE_MAIN);
+	else
+	    walk (start, ROUTINE_MAIN);
+
+	walk_queue ();
+
+	if (bad_addr < 0) {
+	    scan_tables ();
+	    walk_queue ();
+	}
+
+	if (bad_addr < 0) {
+	    qsort (routines, routine_count, sizeof (routine_t), by_start);
+	    if (name != NULL)
+		write_map (name);
+	}
+    }
+
+    free (name);
+    free (headers);
+    free (inside);
+    free (queue);
+    free (todo);
+    free (done);
+
+    headers = NULL;
+    inside = NULL;
+    queue = NULL;
+    todo = NULL;
+    done = NULL;
+    queue_space = todo_space = done_space = 0;
+
+    if (bad_addr >= 0) {
+
+	static char message[64];
+
+	sprintf (message, "Malformed story file (bad instruction at %05lx)",
+	    bad_addr);
+
+	os_fatal (message);
+    }
+
+}/* init_code_map */
+
+
+/*
+ * free_code_map
+ *
+ * Release the memory held by the routine map.
+ *
+ */
+void free_code_map (void)
+{
+    free (routines);
+    free (code_map);
+
+    routines = NULL;
+    code_map = NULL;
+    routine_count = 0;
+    routine_space = 0;
+
+}/* free_code_map */
@@ -103,6 +103,9 @@ void runtime_error (int errnum)
     if (f_setup.err_report_mode == ERR_REPORT_FATAL
 	|| (!f_setup.ignore_errors && errnum <= ERR_MAX_FATAL)) {
 	flush_buffer ();
+	batch_flush ();
+	if (tracing)
+	    trace_dump (NULL);
 	os_fatal (err_messages[errnum - 1]);
 	return;
     }
@@ -110,6 +113,11 @@ void runtime_error (int errnum)
     wasfirst = (error_count[errnum - 1] == 0);
     error_count[errnum - 1]++;
 
+    /* Keep the trace leading up to the first occurrence of each error */
+
+    if (tracing && wasfirst && f_setup.err_report_mode != ERR_REPORT_NEVER)
+	trace_dump (NULL);
+
     if ((f_setup.err_report_mode == ERR_REPORT_ALWAYS)
 	|| (f_setup.err_report_mode == ERR_REPORT_ONCE && wasfirst)) {
 	long pc;
@@ -66,6 +66,18 @@ extern zword restore_quetzal (FILE *, FILE *);
 
 extern void erase_window (zword);
 
+extern void init_object_cache (void);
+extern void reset_object_cache (void);
+extern void free_object_cache (void);
+extern void select_object_opcodes (void);
+
+extern zbyte *prop_deps;
+
+/* Does the property cache depend on the byte at this address? */
+
+#define DEPENDENCY(addr) \
+    (prop_deps != NULL && (prop_deps[(addr) >> 3] & (1 << ((addr) & 7))))
+
 extern void (*op0_opcodes[]) (void);
 extern void (*op1_opcodes[]) (void);
 extern void (*op2_opcodes[]) (void);
@@ -103,6 +115,9 @@ static zbyte *undo_mem = NULL, *prev_zmp, *undo_diff;
 
 static int undo_count = 0;
 
+#define undo_size(p) \
+    ((long) sizeof (undo_t) + (p)->diff_size + (p)->stack_size * (long) sizeof (zword))
+
 
 /*
  * get_header_extension
@@ -448,6 +463,15 @@ void init_memory (void)
     hx_table_size = get_header_extension (HX_TABLE_SIZE);
     hx_unicode_table = get_header_extension (HX_UNICODE_TABLE);
 
+    /* Prepare the object property cache and opcode handlers */
+
+    init_object_cache ();
+    select_object_opcodes ();
+
+    /* Check the code and map its routines */
+
+    init_code_map ();
+
 }/* init_memory */
 
 
@@ -503,6 +527,7 @@ static void free_undo (int count)
 	if (curr_undo == first_undo)
 	    curr_undo = curr_undo->next;
 	first_undo = first_undo->next;
+	usage.undo_memory -= undo_size (p);
 	free (p);
 	undo_count--;
     }
@@ -533,12 +558,39 @@ void reset_memory (void)
     undo_mem = NULL;
     undo_count = 0;
 
+    free_object_cache ();
+    free_code_map ();
+
     if (zmp)
 	free (zmp);
     zmp = NULL;
 }/* reset_memory */
 
 
+/*
+ * update_flags
+ *
+ * React to the game writing the low byte of the flags register.
+ *
+ */
+static void update_flags (zbyte value)
+{
+    h_flags &= ~(SCRIPTING_FLAG | FIXED_FONT_FLAG);
+    h_flags |= value & (SCRIPTING_FLAG | FIXED_FONT_FLAG);
+
+    if (value & SCRIPTING_FLAG) {
+	if (!ostream_script)
+	    script_open ();
+    } else {
+	if (ostream_script)
+	    script_close ();
+    }
+
+    refresh_text_style ();
+
+}/* update_flags */
+
+
 /*
  * storeb
  *
@@ -547,25 +599,21 @@ void reset_memory (void)
  */
 void storeb (zword addr, zbyte value)
 {
-    if (addr >= h_dynamic_size)
-	runtime_error (ERR_STORE_RANGE);
+    /* Fast path: an ordinary byte of dynamic memory past the header */
 
-    if (addr == H_FLAGS + 1) {	/* flags register is modified */
-
-	h_flags &= ~(SCRIPTING_FLAG | FIXED_FONT_FLAG);
-	h_flags |= value & (SCRIPTING_FLAG | FIXED_FONT_FLAG);
+    if (addr >= 64 && addr < h_dynamic_size && !DEPENDENCY (addr)) {
+	SET_BYTE (addr, value);
+	return;
+    }
 
-	if (value & SCRIPTING_FLAG) {
-	    if (!ostream_script)
-		script_open ();
-	} else {
-	    if (ostream_script)
-		script_close ();
-	}
+    if (addr >= h_dynamic_size)
+	runtime_error (ERR_STORE_RANGE);
 
-	refresh_text_style ();
+    if (addr == H_FLAGS + 1)	/* flags register is modified */
+	update_flags (value);
 
-    }
+    if (DEPENDENCY (addr))
+	reset_object_cache ();	/* property list layout changes */
 
     SET_BYTE (addr, value);
 
@@ -580,12 +628,57 @@ void storeb (zword addr, zbyte value)
  */
 void storew (zword addr, zword value)
 {
+    /* Fast path: both bytes are ordinary dynamic memory past the header,
+       so a single range check covers the whole word */
+
+    if (addr >= 64 && addr < h_dynamic_size - 1
+	&& !DEPENDENCY (addr) && !DEPENDENCY (addr + 1)) {
+	SET_WORD (addr, value);
+	return;
+    }
+
     storeb ((zword) (addr + 0), hi (value));
     storeb ((zword) (addr + 1), lo (value));
 
 }/* storew */
 
 
+/*
+ * memory_written
+ *
+ * Apply the side effects of storeb to a range of dynamic memory that
+ * has been written directly, e.g. by a bulk copy. The caller must have
+ * checked that the range lies within dynamic memory.
+ *
+ */
+void memory_written (zword addr, zword count)
+{
+    long end = (long) addr + count;
+    long i;
+
+    if (addr <= H_FLAGS + 1 && end > H_FLAGS + 1)
+	update_flags (zmp[H_FLAGS + 1]);
+
+    if (prop_deps == NULL)
+	return;
+
+    for (i = addr; i < end; i++) {
+
+	/* Skip eight bytes at a time where nothing depends on them */
+
+	if (!(i & 7) && i + 8 <= end && prop_deps[i >> 3] == 0)
+	    { i += 7; continue; }
+
+	if (prop_deps[i >> 3] & (1 << (i & 7))) {
+	    reset_object_cache ();	/* property list layout changes */
+	    break;
+	}
+
+    }
+
+}/* memory_written */
+
+
 /*
  * z_restart, re-load dynamic area, clear the stack and set the PC.
  *
@@ -609,6 +702,8 @@ void z_restart (void)
 	if (fread (zmp, 1, h_dynamic_size, story_fp) != h_dynamic_size)
 	    os_fatal ("Story file read error");
 
+	reset_object_cache ();
+
     } else first_restart = FALSE;
 
     restart_header ();
@@ -706,6 +801,8 @@ void z_restore (void)
 
 	success = fread (zmp + zargs[0], 1, zargs[1], gfp);
 
+	reset_object_cache ();
+
 	/* Close auxilary file */
 
 	fclose (gfp);
@@ -731,6 +828,8 @@ void z_restore (void)
 
 	success = restore_quetzal (gfp, story_fp);
 
+	reset_object_cache ();
+
 	if ((short) success >= 0) {
 
 	    /* Close game file */
@@ -888,6 +987,8 @@ int restore_undo (void)
 
     curr_undo = curr_undo->prev;
 
+    reset_object_cache ();
+
     restart_header ();
 
     return 2;
@@ -921,6 +1022,7 @@ void z_save (void)
     char new_name[MAX_FILE_NAME + 1];
     char default_name[MAX_FILE_NAME + 1];
     FILE *gfp;
+    long size;
 
     zword success = 0;
 
@@ -969,6 +1071,7 @@ void z_save (void)
 	    goto finished;
 
 	success = save_quetzal (gfp, story_fp);
+	size = ftell (gfp);
 
 	/* Close game file and check for errors */
 
@@ -977,6 +1080,20 @@ void z_save (void)
 	    goto finished;
 	}
 
+	/* Keep within the save file limit */
+
+	if (f_setup.max_save_size > 0 && size > f_setup.max_save_size) {
+	    print_string ("Save file too large\n");
+	    remove (new_name);
+	    success = 0;
+	    goto finished;
+	}
+
+	usage.saves++;
+	usage.save_size = size;
+	if (size > usage.peak_save_size)
+	    usage.peak_save_size = size;
+
 	/* Success */
 
 	success = 1;
@@ -1000,7 +1117,7 @@ finished:
  */
 int save_undo (void)
 {
-    long diff_size;
+    long diff_size, size;
     zword stack_size;
     undo_t *p;
     long pc;
@@ -1013,6 +1130,7 @@ int save_undo (void)
     while (last_undo != curr_undo) {
 	p = last_undo;
 	last_undo = last_undo->prev;
+	usage.undo_memory -= undo_size (p);
 	free (p);
 	undo_count--;
     }
@@ -1026,8 +1144,19 @@ int save_undo (void)
 
     diff_size = mem_diff (zmp, prev_zmp, h_dynamic_size, undo_diff);
     stack_size = stack + STACK_SIZE - sp;
+    size = sizeof (undo_t) + diff_size + stack_size * sizeof (*sp);
+
+    /* Make room under the undo memory limit, oldest state first */
+
+    if (f_setup.max_undo_memory > 0) {
+	while (undo_count && usage.undo_memory + size > f_setup.max_undo_memory)
+	    free_undo (1);
+	if (size > f_setup.max_undo_memory)
+	    return -1;
+    }
+
     do {
-	p = malloc (sizeof (undo_t) + diff_size + stack_size * sizeof (*sp));
+	p = malloc (size);
 	if (p == NULL)
 	    free_undo (1);
     } while (!p && undo_count);
@@ -1053,6 +1182,11 @@ int save_undo (void)
     p->next = NULL;
     curr_undo = last_undo = p;
     undo_count++;
+
+    usage.undo_memory += size;
+    if (usage.undo_memory > usage.peak_undo_memory)
+	usage.peak_undo_memory = usage.undo_memory;
+
     return 1;
 
 }/* save_undo */
@@ -19,15 +19,53 @@
  */
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include "frotz.h"
 
+#if defined(__unix__) || defined(__APPLE__)
+#define UNIX_FILES
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 #ifndef SEEK_SET
 #define SEEK_SET 0
 #define SEEK_CUR 1
 #define SEEK_END 2
 #endif
 
+#define SCRIPT_BUFFER_SIZE 8192
+
+/* Binary command files start with a magic number, a version and flags.
+ * Each entry is an optional timestamp (tenths of a second since the
+ * recording started) followed by a tag byte:
+ *
+ *   RECORD_KEY           key
+ *   RECORD_LINE          length, the characters of the line, terminating key
+ *   RECORD_KEY_TIMEOUT   ticks
+ *   RECORD_LINE_TIMEOUT  ticks, length, the characters typed so far
+ *
+ * The timeout entries stand for timed input that was interrupted after
+ * the given number of tenths of a second; playback passes them on to
+ * the game straight away.
+ *
+ * Numbers are unsigned varints (7 bits per byte, low bits first), line
+ * characters are plain ZSCII bytes. A key is a ZSCII code or 1000 plus
+ * a hot key; mouse clicks are followed by the mouse coordinates. */
+
+#define RECORD_MAGIC "FZRC"
+#define RECORD_VERSION 1
+
+#define RECORD_TIMESTAMPS 0x01
+
+#define RECORD_KEY 1
+#define RECORD_LINE 2
+#define RECORD_KEY_TIMEOUT 3
+#define RECORD_LINE_TIMEOUT 4
+
 extern void set_more_prompts (bool);
 
 extern bool is_terminator (zchar);
@@ -43,10 +81,140 @@ extern char latin1_to_ibm[];
 
 static int script_width = 0;
 
+/* Transcript text waiting to be written */
+
+static char *script_buffer = NULL;
+static long script_length = 0;
+static long script_space = 0;
+
 static FILE *sfp = NULL;
 static FILE *rfp = NULL;
 static FILE *pfp = NULL;
 
+/* Binary command files being written or replayed */
+
+static bool record_binary = FALSE;
+static long record_start = 0;
+
+static zbyte *replay_data = NULL;
+static long replay_size = 0;
+static long replay_pos = 0;
+static int replay_flags = 0;
+static bool replay_mapped = FALSE;
+
+/*
+ * script_reserve
+ *
+ * Make room for another 'n' bytes in the transcript buffer.
+ *
+ */
+
+static void script_reserve (long n)
+{
+    char *p;
+
+    if (script_length + n <= script_space)
+	return;
+
+    while (script_length + n > script_space)
+	script_space = script_space ? 2 * script_space : SCRIPT_BUFFER_SIZE;
+
+    if ((p = realloc (script_buffer, script_space)) == NULL)
+	os_fatal ("Out of memory");
+
+    script_buffer = p;
+
+}/* script_reserve */
+
+/*
+ * script_put
+ *
+ * Append a character to the transcript buffer, encoded as UTF-8.
+ *
+ */
+
+static void script_put (zchar c)
+{
+    unsigned u = c;
+
+    script_reserve (3);
+
+#ifdef __MSDOS__
+    if (u >= ZC_LATIN1_MIN)
+	u = (zbyte) latin1_to_ibm[u - ZC_LATIN1_MIN];
+    script_buffer[script_length++] = u;
+#else
+    if (u < 0x80)
+	script_buffer[script_length++] = u;
+    else if (u < 0x800) {
+	script_buffer[script_length++] = 0xc0 | (u >> 6);
+	script_buffer[script_length++] = 0x80 | (u & 0x3f);
+    } else {
+	script_buffer[script_length++] = 0xe0 | (u >> 12);
+	script_buffer[script_length++] = 0x80 | ((u >> 6) & 0x3f);
+	script_buffer[script_length++] = 0x80 | (u & 0x3f);
+    }
+#endif
+
+}/* script_put */
+
+/*
+ * script_size
+ *
+ * Return the number of bytes a character takes up in the transcript.
+ *
+ */
+
+static int script_size (zchar c)
+{
+#ifdef __MSDOS__
+    return 1;
+#else
+    return (c < 0x80) ? 1 : ((unsigned) c < 0x800) ? 2 : 3;
+#endif
+
+}/* script_size */
+
+/*
+ * script_write
+ *
+ * Write the transcript buffer to the file. Returns FALSE on failure.
+ *
+ */
+
+static bool script_write (void)
+{
+    size_t length = script_length;
+
+    script_length = 0;
+
+    if (length != 0 && fwrite (script_buffer, 1, length, sfp) != length)
+	return FALSE;
+
+#ifdef UNIX_FILES
+    if (f_setup.script_sync && length != 0)
+	fsync (fileno (sfp));
+#endif
+
+    return TRUE;
+
+}/* script_write */
+
+/*
+ * script_exit
+ *
+ * Write out what is left of the transcript when the interpreter stops.
+ *
+ */
+
+static void script_exit (void)
+{
+
+    if (sfp != NULL)
+	script_write ();
+
+}/* script_exit */
+
 /*
  * script_open
  *
@@ -64,6 +232,7 @@ static FILE *pfp = NULL;
 void script_open (void)
 {
     static bool script_valid = FALSE;
+    static bool script_registered = FALSE;
 
     char new_name[MAX_FILE_NAME + 1];
 
@@ -83,14 +252,22 @@ void script_open (void)
     if ((sfp = fopen (f_setup.script_name, "r+t")) != NULL ||
 		(sfp = fopen (f_setup.script_name, "w+t")) != NULL) {
 
+	/* The transcript is buffered here, not by stdio */
+
+	setvbuf (sfp, NULL, _IONBF, 0);
+
 	fseek (sfp, 0, SEEK_END);
 
+	if (!script_registered)
+	    script_registered = (atexit (script_exit) == 0);
+
 	h_flags |= SCRIPTING_FLAG;
 
 	script_valid = TRUE;
 	ostream_script = TRUE;
 
 	script_width = 0;
+	script_length = 0;
 
     } else print_string ("Cannot open file\n");
 
@@ -113,10 +290,49 @@ void script_close (void)
     h_flags &= ~SCRIPTING_FLAG;
     SET_WORD (H_FLAGS, h_flags);
 
+    script_write ();
+
     fclose (sfp); ostream_script = FALSE;
 
+    sfp = NULL;
+
 }/* script_close */
 
+/*
+ * script_check
+ *
+ * Write the transcript buffer once as much text as the user asked for
+ * has piled up. Transcription stops if the file cannot be written.
+ *
+ */
+
+static void script_check (void)
+{
+
+    if (f_setup.script_flush > 0
+	&& script_length >= f_setup.script_flush * 1024L
+	&& !script_write ())
+	script_close ();
+
+}/* script_check */
+
+/*
+ * script_end_turn
+ *
+ * The interpreter is about to wait for the player. Unless the user
+ * asked for the transcript to be written in larger blocks, now is the
+ * time to write it.
+ *
+ */
+
+void script_end_turn (void)
+{
+
+    if (f_setup.script_flush <= 0 && !script_write ())
+	script_close ();
+
+}/* script_end_turn */
+
 /*
  * script_new_line
  *
@@ -127,81 +343,110 @@ void script_close (void)
 void script_new_line (void)
 {
 
-    if (fputc ('\n', sfp) == EOF)
-	script_close ();
+    script_put ('\n');
 
     script_width = 0;
 
+    script_check ();
+
 }/* script_new_line */
 
 /*
- * script_char
+ * script_emit
  *
- * Write a single character to the transcript file.
+ * Add a single character to the transcript buffer.
  *
  */
 
-void script_char (zchar c)
+static void script_emit (zchar c)
 {
 
     if (c == ZC_INDENT && script_width != 0)
 	c = ' ';
 
     if (c == ZC_INDENT)
-	{ script_char (' '); script_char (' '); script_char (' '); return; }
+	{ script_emit (' '); script_emit (' '); script_emit (' '); return; }
     if (c == ZC_GAP)
-	{ script_char (' '); script_char (' '); return; }
+	{ script_emit (' '); script_emit (' '); return; }
 
-#ifdef __MSDOS__
-    if (c >= ZC_LATIN1_MIN)
-	c = latin1_to_ibm[c - ZC_LATIN1_MIN];
-#endif
+    script_put (c); script_width++;
 
-    fputc (c, sfp); script_width++;
+}/* script_emit */
+
+/*
+ * script_char
+ *
+ * Write a single character to the transcript file.
+ *
+ */
+
+void script_char (zchar c)
+{
+
+    script_emit (c);
+
+    script_check ();
 
 }/* script_char */
 
 /*
  * script_word
  *
- * Write a string to the transcript file.
+ * Write a string to the transcript file. The word is added to the
+ * buffer in one pass; if it turns out not to fit on the line, a line
+ * break is slipped in front of it (in place of a leading space).
  *
  */
 
 void script_word (const zchar *s)
 {
-    int width;
-    int i;
+    long mark;
+    long skip = 0;
+    int start;
+    int skip_width = 0;
+    int width = 0;
 
     if (*s == ZC_INDENT && script_width != 0)
-	script_char (*s++);
+	script_emit (*s++);
 
-    for (i = 0, width = 0; s[i] != 0; i++)
+    mark = script_length;
+    start = script_width;
 
-	if (s[i] == ZC_NEW_STYLE || s[i] == ZC_NEW_FONT)
-	    i++;
-	else if (s[i] == ZC_GAP)
-	    width += 3;
-	else if (s[i] == ZC_INDENT)
-	    width += 2;
-	else
-	    width += 1;
+    if (*s == ' ' || *s == ZC_INDENT || *s == ZC_GAP) {
 
-    if (f_setup.script_cols != 0 && script_width + width > f_setup.script_cols) {
+	width = (*s == ZC_GAP) ? 3 : (*s == ZC_INDENT) ? 2 : 1;
 
-	if (*s == ' ' || *s == ZC_INDENT || *s == ZC_GAP)
-	    s++;
+	script_emit (*s++);
 
-	script_new_line ();
+	skip = script_length - mark;
+	skip_width = script_width - start;
 
     }
 
-    for (i = 0; s[i] != 0; i++)
+    for (; *s != 0; s++)
 
-	if (s[i] == ZC_NEW_FONT || s[i] == ZC_NEW_STYLE)
-	    i++;
-	else
-	    script_char (s[i]);
+	if (*s == ZC_NEW_STYLE || *s == ZC_NEW_FONT)
+	    s++;
+	else {
+	    width += (*s == ZC_GAP) ? 3 : (*s == ZC_INDENT) ? 2 : 1;
+	    script_emit (*s);
+	}
+
+    if (f_setup.script_cols != 0 && start + width > f_setup.script_cols) {
+
+	script_reserve (1);
+
+	memmove (script_buffer + mark + 1, script_buffer + mark + skip,
+		 script_length - mark - skip);
+
+	script_buffer[mark] = '\n';
+	script_length += 1 - skip;
+
+	script_width -= start + skip_width;
+
+    }
+
+    script_check ();
 
 }/* script_word */
 
@@ -224,10 +469,12 @@ void script_write_input (const zchar *buf, zchar key)
 	script_new_line ();
 
     for (i = 0; buf[i] != 0; i++)
-	script_char (buf[i]);
+	script_emit (buf[i]);
 
     if (key == ZC_RETURN)
 	script_new_line ();
+    else
+	script_check ();
 
 }/* script_write_input */
 
@@ -240,13 +487,21 @@ void script_write_input (const zchar *buf, zchar key)
 
 void script_erase_input (const zchar *buf)
 {
+    long size;
     int width;
     int i;
 
-    for (i = 0, width = 0; buf[i] != 0; i++)
-	width++;
+    for (i = 0, width = 0, size = 0; buf[i] != 0; i++)
+	{ width++; size += script_size (buf[i]); }
 
-    fseek (sfp, -width, SEEK_CUR); script_width -= width;
+    /* The line is normally still in the buffer */
+
+    if (size <= script_length)
+	script_length -= size;
+    else if (script_write ())
+	fseek (sfp, -size, SEEK_CUR);
+
+    script_width -= width;
 
 }/* script_erase_input */
 
@@ -281,6 +536,42 @@ void script_mssg_off (void)
 
 }/* script_mssg_off */
 
+/*
+ * binary_name
+ *
+ * Return TRUE if a command file name asks for the binary format.
+ *
+ */
+
+static bool binary_name (const char *name)
+{
+    size_t length = strlen (name);
+    size_t ext = strlen (EXT_COMMAND_BINARY);
+
+    return length >= ext && !strcmp (name + length - ext, EXT_COMMAND_BINARY);
+
+}/* binary_name */
+
+/*
+ * record_clock
+ *
+ * Return the time in tenths of a second.
+ *
+ */
+
+static long record_clock (void)
+{
+#ifdef UNIX_FILES
+    struct timespec now;
+
+    if (clock_gettime (CLOCK_MONOTONIC, &now) == 0)
+	return (long) now.tv_sec * 10 + now.tv_nsec / 100000000;
+#endif
+
+    return (long) time (NULL) * 10;
+
+}/* record_clock */
+
 /*
  * record_open
  *
@@ -296,10 +587,27 @@ void record_open (void)
 
 	strcpy (f_setup.command_name, new_name);
 
-	if ((rfp = fopen (new_name, "wt")) != NULL)
+	record_binary = binary_name (new_name);
+
+	if ((rfp = fopen (new_name, record_binary ? "wb" : "wt")) != NULL) {
+
+	    if (record_binary) {
+
+		zbyte header[6];
+
+		memcpy (header, RECORD_MAGIC, 4);
+		header[4] = RECORD_VERSION;
+		header[5] = RECORD_TIMESTAMPS;
+
+		fwrite (header, 1, sizeof header, rfp);
+
+		record_start = record_clock ();
+
+	    }
+
 	    ostream_record = TRUE;
-	else
-	    print_string ("Cannot open file\n");
+
+	} else print_string ("Cannot open file\n");
 
     }
 
@@ -355,7 +663,9 @@ static void record_code (int c, bool force_encoding)
 static void record_char (zchar c)
 {
 
-    if (c != ZC_RETURN) {
+    if (c == ZC_TIME_OUT)	/* replayed as a timeout, not as '?' */
+	record_code (0, TRUE);
+    else if (c != ZC_RETURN) {
 	if (c < ZC_HKEY_MIN || c > ZC_HKEY_MAX) {
 	    record_code (translate_to_zscii (c), FALSE);
 	    if (c == ZC_SINGLE_CLICK || c == ZC_DOUBLE_CLICK) {
@@ -367,16 +677,110 @@ static void record_char (zchar c)
 
 }/* record_char */
 
+/*
+ * put_varint
+ *
+ * Store a number as a varint, returning the number of bytes used.
+ *
+ */
+
+static int put_varint (zbyte *p, unsigned long value)
+{
+    int n = 0;
+
+    while (value >= 0x80) {
+	p[n++] = 0x80 | (value & 0x7f);
+	value >>= 7;
+    }
+
+    p[n++] = (zbyte) value;
+
+    return n;
+
+}/* put_varint */
+
+/*
+ * put_key
+ *
+ * Store a key (and the mouse position for clicks) as varints.
+ *
+ */
+
+static int put_key (zbyte *p, zchar key)
+{
+    int n;
+
+    if (key >= ZC_HKEY_MIN && key <= ZC_HKEY_MAX)
+	return put_varint (p, 1000 + key - ZC_HKEY_MIN);
+
+    n = put_varint (p, translate_to_zscii (key));
+
+    if (key == ZC_SINGLE_CLICK || key == ZC_DOUBLE_CLICK) {
+	n += put_varint (p + n, mouse_x);
+	n += put_varint (p + n, mouse_y);
+    }
+
+    return n;
+
+}/* put_key */
+
+/*
+ * record_entry
+ *
+ * Write an entry to a binary command file. A NULL line means that a
+ * single key is recorded.
+ *
+ */
+
+static void record_entry (const zchar *buf, zchar key, zword timeout)
+{
+    zbyte entry[INPUT_BUFFER_SIZE + 32];
+    int n;
+
+    n = put_varint (entry, record_clock () - record_start);
+
+    if (key == ZC_TIME_OUT) {
+	entry[n++] = (buf != NULL) ? RECORD_LINE_TIMEOUT : RECORD_KEY_TIMEOUT;
+	n += put_varint (entry + n, timeout);
+    } else
+	entry[n++] = (buf != NULL) ? RECORD_LINE : RECORD_KEY;
+
+    if (buf != NULL) {
+
+	int length = 0;
+
+	while (buf[length] != 0 && length < INPUT_BUFFER_SIZE)
+	    length++;
+
+	n += put_varint (entry + n, length);
+
+	while (*buf != 0 && length-- != 0)
+	    entry[n++] = translate_to_zscii (*buf++);
+
+    }
+
+    if (key != ZC_TIME_OUT)
+	n += put_key (entry + n, key);
+
+    if (fwrite (entry, 1, n, rfp) != (size_t) n)
+	record_close ();
+
+}/* record_entry */
+
 /*
  * record_write_key
  *
- * Copy a keystroke to the command file.
+ * Copy a keystroke to the command file. The timeout is only needed if
+ * the key is ZC_TIME_OUT.
  *
  */
 
-void record_write_key (zchar key)
+void record_write_key (zchar key, zword timeout)
 {
 
+    if (record_binary)
+	{ record_entry (NULL, key, timeout); return; }
+
     record_char (key);
 
     if (fputc ('\n', rfp) == EOF)
@@ -387,14 +791,18 @@ void record_write_key (zchar key)
 /*
  * record_write_input
  *
- * Copy a line of input to a command file.
+ * Copy a line of input to a command file. The timeout is only needed if
+ * the line was interrupted (key is ZC_TIME_OUT).
  *
  */
 
-void record_write_input (const zchar *buf, zchar key)
+void record_write_input (const zchar *buf, zchar key, zword timeout)
 {
     zchar c;
 
+    if (record_binary)
+	{ record_entry (buf, key, timeout); return; }
+
     while ((c = *buf++) != 0)
 	record_char (c);
 
@@ -405,6 +813,61 @@ void record_write_input (const zchar *buf, zchar key)
 
 }/* record_write_input */
 
+/*
+ * replay_load
+ *
+ * Bring a binary command file into memory, mapping it where possible.
+ * Returns FALSE if there is not enough memory; the file is closed in
+ * any case.
+ *
+ */
+
+static bool replay_load (void)
+{
+    long size;
+
+    fseek (pfp, 0, SEEK_END);
+    size = ftell (pfp);
+
+    replay_data = NULL;
+    replay_mapped = FALSE;
+
+#ifdef UNIX_FILES
+    if (size > 0) {
+
+	void *p = mmap (NULL, size, PROT_READ, MAP_PRIVATE, fileno (pfp), 0);
+
+	if (p != MAP_FAILED) {
+	    replay_data = p;
+	    replay_mapped = TRUE;
+	}
+
+    }
+#endif
+
+    if (replay_data == NULL && size > 0
+	&& (replay_data = malloc (size)) != NULL) {
+
+	fseek (pfp, 0, SEEK_SET);
+
+	if (fread (replay_data, 1, size, pfp) != (size_t) size)
+	    { free (replay_data); replay_data = NULL; }
+
+    }
+
+    fclose (pfp); pfp = NULL;
+
+    if (replay_data == NULL)
+	return FALSE;
+
+    replay_size = size;
+    replay_flags = replay_data[5];
+    replay_pos = 6;
+
+    return TRUE;
+
+}/* replay_load */
+
 /*
  * replay_open
  *
@@ -420,7 +883,24 @@ void replay_open (void)
 
 	strcpy (f_setup.command_name, new_name);
 
-	if ((pfp = fopen (new_name, "rt")) != NULL) {
+	if ((pfp = fopen (new_name, "rb")) != NULL) {
+
+	    zbyte header[6];
+
+	    if (fread (header, 1, 6, pfp) == 6 && !memcmp (header, RECORD_MAGIC, 4)) {
+
+		if (header[4] != RECORD_VERSION || !replay_load ()) {
+		    if (pfp != NULL)
+			fclose (pfp);
+		    pfp = NULL;
+		    print_string ("Cannot read file\n");
+		    return;
+		}
+
+	    } else if ((pfp = freopen (new_name, "rt", pfp)) == NULL) {
+		print_string ("Cannot open file\n");
+		return;
+	    }
 
 	    set_more_prompts (read_yes_or_no ("Do you want MORE prompts"));
 
@@ -444,7 +924,23 @@ void replay_close (void)
 
     set_more_prompts (TRUE);
 
-    fclose (pfp); istream_replay = FALSE;
+    if (replay_data != NULL) {
+
+#ifdef UNIX_FILES
+	if (replay_mapped)
+	    munmap (replay_data, replay_size);
+	else
+#endif
+	    free (replay_data);
+
+	replay_data = NULL;
+
+    }
+
+    if (pfp != NULL)
+	fclose (pfp);
+
+    pfp = NULL; istream_replay = FALSE;
 
 }/* replay_close */
 
@@ -511,6 +1007,135 @@ static zchar replay_char (void)
 
 }/* replay_char */
 
+/*
+ * get_varint
+ *
+ * Fetch a varint from a binary command file. Returns FALSE at the end
+ * of the file.
+ *
+ */
+
+static bool get_varint (unsigned long *value)
+{
+    int shift = 0;
+
+    *value = 0;
+
+    while (replay_pos < replay_size && shift < 32) {
+
+	zbyte b = replay_data[replay_pos++];
+
+	*value |= (unsigned long) (b & 0x7f) << shift;
+
+	if (!(b & 0x80))
+	    return TRUE;
+
+	shift += 7;
+
+    }
+
+    return FALSE;
+
+}/* get_varint */
+
+/*
+ * get_key
+ *
+ * Fetch a key from a binary command file.
+ *
+ */
+
+static zchar get_key (void)
+{
+    unsigned long c, x, y;
+
+    if (!get_varint (&c))
+	return ZC_BAD;
+
+    if (c >= 1000)
+	return (c - 1000 <= ZC_HKEY_MAX - ZC_HKEY_MIN) ? ZC_HKEY_MIN + c - 1000 : ZC_BAD;
+
+    if (c > 0xff)
+	return ZC_BAD;
+
+    c = translate_from_zscii (c);
+
+    if (c == ZC_SINGLE_CLICK || c == ZC_DOUBLE_CLICK) {
+
+	if (!get_varint (&x) || !get_varint (&y))
+	    return ZC_BAD;
+
+	mouse_x = x;
+	mouse_y = y;
+
+    }
+
+    return c;
+
+}/* get_key */
+
+/*
+ * replay_entry
+ *
+ * Read the next entry from a binary command file. For a line entry the
+ * characters are stored in 'buf' (if it is not NULL) and their number
+ * in 'length'. Returns the terminating key (ZC_TIME_OUT for a timeout
+ * entry), or ZC_BAD if the file is exhausted or broken.
+ *
+ */
+
+static zchar replay_entry (zchar *buf, int *length)
+{
+    unsigned long n, stamp, ticks;
+    zbyte tag;
+
+    *length = -1;
+
+    if (replay_flags & RECORD_TIMESTAMPS)
+	if (!get_varint (&stamp))
+	    return ZC_BAD;
+
+    if (replay_pos >= replay_size)
+	return ZC_BAD;
+
+    tag = replay_data[replay_pos++];
+
+    if (tag == RECORD_KEY_TIMEOUT || tag == RECORD_LINE_TIMEOUT)
+	if (!get_varint (&ticks))
+	    return ZC_BAD;
+
+    if (tag == RECORD_LINE || tag == RECORD_LINE_TIMEOUT) {
+
+	if (!get_varint (&n) || n >= INPUT_BUFFER_SIZE || n > replay_size - replay_pos)
+	    return ZC_BAD;
+
+	*length = n;
+
+	if (buf != NULL) {
+
+	    const zbyte *p = replay_data + replay_pos;
+
+	    while (n-- != 0)
+		*buf++ = translate_from_zscii (*p++);
+
+	    *buf = 0;
+
+	}
+
+	replay_pos += *length;
+
+    } else if (tag != RECORD_KEY && tag != RECORD_KEY_TIMEOUT)
+	return ZC_BAD;
+
+    /* A timeout is injected at once, however long it took originally */
+
+    if (tag == RECORD_KEY_TIMEOUT || tag == RECORD_LINE_TIMEOUT)
+	return ZC_TIME_OUT;
+
+    return get_key ();
+
+}/* replay_entry */
+
 /*
  * replay_read_key
  *
@@ -522,6 +1147,27 @@ zchar replay_read_key (void)
 {
     zchar key;
 
+    if (replay_data != NULL) {
+
+	int length;
+	zchar c[INPUT_BUFFER_SIZE];
+
+	/* Accept a line holding a single character, like the text format */
+
+	key = replay_entry (c, &length);
+
+	if (length == 1 && key == ZC_RETURN)
+	    key = c[0];
+	else if (length > 0)
+	    key = ZC_BAD;
+
+	if (key == ZC_BAD)
+	    replay_close ();
+
+	return key;
+
+    }
+
     key = replay_char ();
 
     if (fgetc (pfp) != '\n') {
@@ -544,6 +1190,27 @@ zchar replay_read_input (zchar *buf)
 {
     zchar c;
 
+    if (replay_data != NULL) {
+
+	int length;
+
+	c = replay_entry (buf, &length);
+
+	/* A single key counts as a one-character line, like in the text
+	   format */
+
+	if (length < 0 && c != ZC_BAD && !is_terminator (c))
+	    { buf[0] = c; buf[1] = 0; c = ZC_RETURN; }
+	else if (length < 0)
+	    buf[0] = 0;
+
+	if (c == ZC_BAD)
+	    replay_close ();
+
+	return c;
+
+    }
+
     for (;;) {
 
 	c = replay_char ();
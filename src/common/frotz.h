@@ -138,6 +138,9 @@ typedef struct {
 #ifndef TEXT_BUFFER_SIZE
 #define TEXT_BUFFER_SIZE 275
 #endif
+#ifndef SCROLLBACK_SIZE
+#define SCROLLBACK_SIZE 500
+#endif
 #ifndef INPUT_BUFFER_SIZE
 #define INPUT_BUFFER_SIZE 200
 #endif
@@ -157,7 +160,10 @@ extern const char
 #define EXT_BLORB3	".blorb"
 #define EXT_BLORB4	".zblorb"
 #define EXT_COMMAND	".rec"
+#define EXT_COMMAND_BINARY	".zrec"
 #define EXT_AUX		".aux"
+#define EXT_TRACE	".trc"
+#define EXT_CODE_MAP	".map"
 
 #ifndef DEFAULT_SAVE_NAME
 #define DEFAULT_SAVE_NAME "story.sav"
@@ -455,19 +461,71 @@ extern zbyte *zmp;
 
 #if !defined (AMIGA) && !defined (MSDOS_16BIT)
 
+#include <string.h>
+
 extern zbyte *pcp;
 extern zbyte *zmp;
 
 #define lo(v)	(v & 0xff)
 #define hi(v)	(v >> 8)
 
-#define SET_WORD(addr,v)  { zmp[addr] = hi(v); zmp[addr+1] = lo(v); }
-#define LOW_WORD(addr,v)  { v = ((zword) zmp[addr] << 8) | zmp[addr+1]; }
-#define HIGH_WORD(addr,v) { v = ((zword) zmp[addr] << 8) | zmp[addr+1]; }
-#define CODE_WORD(v)      { v = ((zword) pcp[0] << 8) | pcp[1]; pcp += 2; }
+/*
+ * Words are stored big-endian and need not be aligned. Where the
+ * compiler tells us the host byte order, a word is moved with a single
+ * (unaligned-safe) memcpy and byte swapped if necessary; otherwise it
+ * is assembled from its two bytes.
+ */
+
+#if defined (__GNUC__) && defined (__BYTE_ORDER__)
+
+static inline zword load_word (const zbyte *p)
+{
+    zword v;
+
+    memcpy (&v, p, sizeof (v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap16 (v);
+#endif
+    return v;
+}
+
+static inline void store_word (zbyte *p, zword v)
+{
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap16 (v);
+#endif
+    memcpy (p, &v, sizeof (v));
+}
+
+#else
+
+static inline zword load_word (const zbyte *p)
+{
+    return ((zword) p[0] << 8) | p[1];
+}
+
+static inline void store_word (zbyte *p, zword v)
+{
+    p[0] = hi(v);
+    p[1] = lo(v);
+}
+
+#endif
+
+#define SET_WORD(addr,v)  { store_word (zmp + (addr), v); }
+#define LOW_WORD(addr,v)  { v = load_word (zmp + (addr)); }
+#define HIGH_WORD(addr,v) { v = load_word (zmp + (addr)); }
+#define CODE_WORD(v)      { v = load_word (pcp); pcp += 2; }
 #define GET_PC(v)         { v = pcp - zmp; }
 #define SET_PC(v)         { pcp = zmp + v; }
 
+#else
+
+/* Byte-wise fallbacks for the word access helpers */
+
+#define load_word(p)     (((zword) (p)[0] << 8) | (p)[1])
+#define store_word(p,v)  { zword w_ = (v); (p)[0] = w_ >> 8; (p)[1] = w_ & 0xff; }
+
 #endif
 
 
@@ -527,6 +585,8 @@ extern zword frame_count;
 extern zword zargs[8];
 extern int zargc;
 
+extern volatile sig_atomic_t tick_requested;
+
 extern bool ostream_screen;
 extern bool ostream_script;
 extern bool ostream_memory;
@@ -728,6 +788,136 @@ void	runtime_error (int);
 
 #define ERR_DEFAULT_REPORT_MODE ERR_REPORT_ONCE
 
+/*** Text measurement, see text_width_mode ***/
+
+#define WIDTH_STRING 0		/* ask os_string_width about every word */
+#define WIDTH_CHARS 1		/* strings are as wide as their characters */
+#define WIDTH_FIXED 2		/* every character is one unit wide */
+
+extern int text_width_mode;
+
+/*** Batched screen output ***/
+
+#define BATCH_TEXT 0		/* run of text, NUL terminated in the arena */
+#define BATCH_CURSOR 1		/* cursor move to (top, left) */
+#define BATCH_ERASE 2		/* erase area, units = window */
+#define BATCH_SCROLL 3		/* scroll area by units */
+
+typedef struct {
+    zbyte type;
+    zbyte window;		/* window the event happened in */
+    zbyte style;
+    zbyte font;
+    short foreground;
+    short background;
+    short top, left, bottom, right;
+    short units;
+    long text;			/* offset of the text run in the arena */
+    int length;			/* length of the text run */
+} batch_event_t;
+
+typedef void (*batch_sink_t) (const batch_event_t *, int, const zchar *);
+
+void	batch_set_sink (batch_sink_t);
+void	batch_flush (void);
+void	batch_replay (const batch_event_t *, int, const zchar *);
+void	batch_reset (void);
+void	batch_discard (bool);
+
+void	batch_display_char (zchar);
+void	batch_display_string (const zchar *);
+void	batch_set_cursor (int, int);
+void	batch_erase_area (int, int, int, int, int);
+void	batch_scroll_area (int, int, int, int, int);
+void	batch_set_text_style (int);
+void	batch_set_font (int);
+void	batch_set_colour (int, int);
+
+/*** Scrollback history of the lower window ***/
+
+void	init_scrollback (void);
+void	scrollback_char (zchar);
+void	scrollback_string (const zchar *);
+void	scrollback_attribute (zchar, int);
+void	scrollback_new_line (void);
+int	scrollback_count (void);
+long	scrollback_started (void);
+const zchar *scrollback_line (int, int *);
+
+/*** Resource accounting, see usage.c ***/
+
+typedef struct {
+    long instructions;			/* executed in this session */
+    long turns;				/* turns finished */
+    long turn_instructions;		/* executed in the current turn */
+    long turn_time;			/* CPU ms used by the current turn */
+    long turn_wall_time;		/* wall ms taken by the current turn */
+    long peak_turn_instructions;	/* most in a finished turn */
+    long peak_turn_time;		/* most CPU ms in a finished turn */
+    long peak_turn_wall_time;		/* most wall ms in a finished turn */
+    long cpu_time;			/* CPU ms used by the session */
+    long wall_time;			/* seconds since the session started */
+    long undo_memory;			/* bytes held for undo */
+    long peak_undo_memory;
+    long output;			/* characters sent to screen or transcript */
+    long saves;				/* games saved */
+    long save_size;			/* bytes in the last saved game */
+    long peak_save_size;
+} usage_t;
+
+extern usage_t usage;
+
+void	init_usage (void);
+long	wall_ms (void);
+void	usage_end_turn (long, long, long);
+void	usage_check (void);
+void	get_usage (usage_t *);
+
+/*** Instruction trace, see trace.c ***/
+
+extern bool tracing;
+
+void	init_trace (void);
+void	trace_begin (void);
+void	trace_result (long, zword *);
+long	trace_mark (void);
+void	trace_return (long);
+long	trace_dump (const char *);
+
+/*** Routine map, see codemap.c ***/
+
+typedef struct {
+    long start;			/* address of the routine header */
+    long entry;			/* address of the first instruction */
+    long end;			/* address after the last instruction */
+    zbyte locals;
+    zbyte flags;
+} routine_t;
+
+#define ROUTINE_MAIN	0x01	/* where the game starts */
+#define ROUTINE_CALLED	0x02	/* called with a constant address */
+#define ROUTINE_TABLE	0x04	/* address found in a table */
+#define ROUTINE_DYNAMIC	0x08	/* has code in dynamic memory */
+
+extern routine_t *routines;
+extern long routine_count;
+extern zbyte *code_map;
+
+/* Does an instruction start at this address? */
+
+#define IS_INSTRUCTION(addr) \
+    (code_map != NULL && (code_map[(addr) >> 3] & (1 << ((addr) & 7))))
+
+/* Some of the flags returned by opcode_info */
+
+#define OPCODE_STORE	0x01	/* followed by a variable to store to */
+#define OPCODE_BRANCH	0x02	/* followed by a branch */
+
+void	init_code_map (void);
+void	free_code_map (void);
+routine_t *find_routine (long);
+zbyte	opcode_info (zbyte, zbyte);
+
 /*** Assorted initialization functions ***/
 void   init_buffer (void);
 void   init_process (void);
@@ -806,10 +996,29 @@ void 	os_warn (const char *, ...);
 void	os_quit (void);
 
 /**
- * Called regularly by the interpreter, at least every few instructions
- * (only when interpreting: e.g., not when waiting for input).
+ * Called by the interpreter (only when interpreting: e.g., not when
+ * waiting for input) after the interface has set tick_requested, which
+ * it may do from a signal handler or another thread, and every so many
+ * instructions if it has asked for that with set_tick_interval.
  */
 void    os_tick (void);
+void    set_tick_interval (long);
+
+/* What to do when a turn runs out of its instruction or time budget
+   (f_setup.turn_instructions and f_setup.turn_time). The hook is given
+   a description of where the game is and returns one of these. */
+
+#define BUDGET_RESUME 0		/* give the turn another budget */
+#define BUDGET_UNDO 1		/* take back the turn if the game allows */
+#define BUDGET_QUIT 2		/* stop with a fatal error */
+
+typedef int (*budget_hook_t) (const char *);
+
+void	set_budget_hook (budget_hook_t);
+void	start_turn (void);
+void	end_turn (void);
+long	turn_usage (long *, long *);
+int	call_stack (long *, int);
 
 /* Front ends call this if the terminal size changes. */
 void    resize_screen(void);
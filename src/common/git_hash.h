@@ -0,0 +1,4 @@
+#define GIT_BRANCH "master"
+#define GIT_HASH "3580f8e7a727a2ee5c3fba85ab65cae31ff826ac"
+#define GIT_HASH_SHORT "3580f8e"
+#define GIT_TAG ""
@@ -33,6 +33,8 @@ extern void record_close (void);
 
 extern void seed_random (int);
 
+extern void select_object_opcodes (void);
+
 /*
  * hot_key_debugging
  *
@@ -50,6 +52,8 @@ static bool hot_key_debugging (void)
     f_setup.object_movement = read_yes_or_no ("Watch object movement");
     f_setup.object_locating = read_yes_or_no ("Watch object locating");
 
+    select_object_opcodes ();
+
     return FALSE;
 
 }/* hot_key_debugging */
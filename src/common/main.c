@@ -151,6 +151,12 @@ int cdecl main (int argc, char *argv[])
 
     init_buffer ();
 
+    init_scrollback ();
+
+    init_usage ();
+
+    init_trace ();
+
     init_err ();
 
     init_memory ();
@@ -167,6 +173,8 @@ int cdecl main (int argc, char *argv[])
 
     interpret ();
 
+    batch_flush ();
+
     reset_memory ();
 
     os_reset_screen ();
@@ -18,6 +18,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include "frotz.h"
 
 #define MAX_OBJECT 2000
@@ -34,6 +36,80 @@
 #define O4_PROPERTY_OFFSET 12
 #define O4_SIZE 14
 
+/* Longest property list we are willing to index */
+
+#define MAX_PROPERTIES 255
+
+/* Number of property ids (and default values) for V1-3 and V4+ */
+
+#define O1_PROPERTIES 32
+#define O4_PROPERTIES 64
+
+#define PROP_WORD 0x01		/* @get_prop/@put_prop access a word */
+#define PROP_LONG 0x02		/* property has a two byte size field */
+
+/*
+ * The property cache keeps, for every object, the start of its property
+ * list and a flattened copy of the list itself: one entry per property,
+ * in the (descending) order of the story file. Entries are built on the
+ * first property access and stay valid until the game writes to a byte
+ * they were derived from, i.e. the property pointer of the object, the
+ * length byte of the object name or a property size byte. All of these
+ * bytes are flagged in prop_deps, which storeb checks on every write.
+ * Anything that replaces dynamic memory wholesale (restart, restore,
+ * undo) throws the cache away as well.
+ *
+ * Each object also has a slot table, which maps a property number to
+ * the first entry whose number is not greater, i.e. to the entry that
+ * a scan down the list would stop at. The property defaults table is
+ * kept in native byte order and tracked the same way.
+ */
+
+typedef struct {
+    zword addr;			/* address of the property size byte */
+    zbyte id;			/* property number */
+    zbyte flags;
+} prop_entry_t;
+
+typedef struct {
+    bool valid;
+    zword first;		/* address of the first property */
+    int count;
+    int capacity;
+    prop_entry_t *props;
+    zbyte slot[O4_PROPERTIES];	/* property number -> entry index */
+} obj_cache_t;
+
+/*
+ * Object entries are located relative to a precomputed object 0 entry,
+ * so that entry obj starts at obj_base + obj * entry size. Objects out
+ * of range still go through object_address, which reports the error.
+ * O1_ENTRY skips the range test for V1-3 object numbers that are known
+ * to fit in a byte: links read from the tree, or operands the handler
+ * has checked already.
+ */
+
+#define O1_ENTRY(obj) ((zword) (obj_base + (obj) * O1_SIZE))
+#define O1_ADDR(obj) ((obj) <= 255 ? O1_ENTRY (obj) : object_address (obj))
+#define O4_ADDR(obj) ((obj) <= MAX_OBJECT ? (zword) (obj_base + (obj) * O4_SIZE) : object_address (obj))
+
+extern void (*op1_opcodes[]) (void);
+extern void (*var_opcodes[]) (void);
+
+static zword obj_base = 0;
+
+static obj_cache_t *obj_cache = NULL;
+static obj_cache_t scratch_cache;
+static int max_cached_object = 0;
+
+static zword prop_defaults[O4_PROPERTIES];
+static int max_property = 0;
+static bool defaults_valid = FALSE;
+
+static zbyte prop_length[256];		/* size byte -> property length */
+
+zbyte *prop_deps = NULL;
+
 
 /*
  * object_address
@@ -157,104 +233,402 @@ static zword next_property (zword prop_addr)
 
 
 /*
- * unlink_object
+ * mark_dependency
  *
- * Unlink an object from its parent and siblings.
+ * Remember that the property cache depends on a byte of dynamic memory.
  *
  */
-static void unlink_object (zword object)
+static void mark_dependency (zword addr)
 {
-    zword obj_addr;
-    zword parent_addr;
-    zword sibling_addr;
+    if (addr < h_dynamic_size)
+	prop_deps[addr >> 3] |= 1 << (addr & 7);
+
+}/* mark_dependency */
+
+
+/*
+ * init_object_cache
+ *
+ * Allocate the property cache. Called once the story file is loaded.
+ *
+ */
+void init_object_cache (void)
+{
+    int i;
+
+    max_cached_object = (h_version <= V3) ? 255 : MAX_OBJECT;
+    max_property = (h_version <= V3) ? O1_PROPERTIES - 1 : O4_PROPERTIES - 1;
+    defaults_valid = FALSE;
+
+    /* Decode every possible size byte in advance */
+
+    for (i = 0; i < 256; i++) {
+
+	if (h_version <= V3)
+	    prop_length[i] = (i >> 5) + 1;
+	else if (!(i & 0x80))
+	    prop_length[i] = (i >> 6) + 1;
+	else if (i & 0x3f)
+	    prop_length[i] = i & 0x3f;
+	else
+	    prop_length[i] = 64;	/* demanded by Spec 1.0 */
 
-    if (object == 0) {
-	runtime_error (ERR_REMOVE_OBJECT_0);
-	return;
     }
 
-    obj_addr = object_address (object);
+    obj_cache = calloc (max_cached_object + 1, sizeof (obj_cache_t));
+    prop_deps = calloc ((h_dynamic_size >> 3) + 1, 1);
 
-    if (h_version <= V3) {
+    if (obj_cache == NULL || prop_deps == NULL)
+	os_fatal ("Out of memory");
 
-	zbyte parent;
-	zbyte younger_sibling;
-	zbyte older_sibling;
-	zbyte zero = 0;
+}/* init_object_cache */
 
-	/* Get parent of object, and return if no parent */
 
-	obj_addr += O1_PARENT;
-	LOW_BYTE (obj_addr, parent)
-	if (!parent)
-	    return;
+/*
+ * free_object_cache
+ *
+ * Release the memory held by the property cache.
+ *
+ */
+void free_object_cache (void)
+{
+    int i;
 
-	/* Get (older) sibling of object and set both parent and sibling
-	   pointers to 0 */
+    if (obj_cache != NULL) {
+	for (i = 0; i <= max_cached_object; i++)
+	    free (obj_cache[i].props);
+	free (obj_cache);
+    }
+
+    free (scratch_cache.props);
+    free (prop_deps);
+
+    memset (&scratch_cache, 0, sizeof (scratch_cache));
+    obj_cache = NULL;
+    prop_deps = NULL;
+
+}/* free_object_cache */
+
+
+/*
+ * reset_object_cache
+ *
+ * Forget all cached property lists. This must be called whenever a
+ * byte flagged in prop_deps changes, or dynamic memory is reloaded.
+ *
+ */
+void reset_object_cache (void)
+{
+    int i;
+
+    if (obj_cache == NULL)
+	return;
+
+    for (i = 0; i <= max_cached_object; i++)
+	obj_cache[i].valid = FALSE;
+
+    defaults_valid = FALSE;
+
+    memset (prop_deps, 0, (h_dynamic_size >> 3) + 1);
+
+}/* reset_object_cache */
+
+
+/*
+ * build_object_cache
+ *
+ * Walk the property list of an object and fill in its cache entry. The
+ * list always ends with the terminating entry (property number 0), so
+ * a scan for any property number is guaranteed to stop.
+ *
+ */
+static void build_object_cache (obj_cache_t *c, zword obj)
+{
+    prop_entry_t *p;
+    zword prop_addr;
+    zword name_addr;
+    zbyte value;
+    zbyte mask;
+    int id, i;
+    bool track = (c != &scratch_cache);
+
+    /* Property id is in bottom five (six) bits */
+
+    mask = (h_version <= V3) ? 0x1f : 0x3f;
 
-	SET_BYTE (obj_addr, zero)
-	obj_addr += O1_SIBLING - O1_PARENT;
-	LOW_BYTE (obj_addr, older_sibling)
-	SET_BYTE (obj_addr, zero)
+    if (track) {
 
-	/* Get first child of parent (the youngest sibling of the object) */
+	prop_addr = object_address (obj);
+	prop_addr += (h_version <= V3) ? O1_PROPERTY_OFFSET : O4_PROPERTY_OFFSET;
 
-	parent_addr = object_address (parent) + O1_CHILD;
-	LOW_BYTE (parent_addr, younger_sibling)
+	mark_dependency (prop_addr);
+	mark_dependency ((zword) (prop_addr + 1));
+
+	name_addr = object_name (obj);
+	mark_dependency (name_addr);
+
+    }
+
+    c->first = prop_addr = first_property (obj);
+    c->count = 0;
+
+    for (;;) {
 
-	/* Remove object from the list of siblings */
+	if (c->count == c->capacity) {
+
+	    c->capacity = c->capacity ? 2 * c->capacity : 16;
+
+	    if ((p = realloc (c->props, c->capacity * sizeof (prop_entry_t))) == NULL)
+		os_fatal ("Out of memory");
+
+	    c->props = p;
 
-	if (younger_sibling == object)
-	    SET_BYTE (parent_addr, older_sibling)
-	else {
-	    do {
-		sibling_addr = object_address (younger_sibling) + O1_SIBLING;
-		LOW_BYTE (sibling_addr, younger_sibling)
-	    } while (younger_sibling != object);
-	    SET_BYTE (sibling_addr, older_sibling)
 	}
 
-    } else {
+	LOW_BYTE (prop_addr, value)
 
-	zword parent;
-	zword younger_sibling;
-	zword older_sibling;
-	zword zero = 0;
+	if (track)
+	    mark_dependency (prop_addr);
+
+	p = c->props + c->count++;
+	p->addr = prop_addr;
+	p->id = value & mask;
+	p->flags = 0;
+
+	if (h_version <= V3) {
+	    if (value & 0xe0)
+		p->flags |= PROP_WORD;
+	} else {
+	    if (value & 0xc0)
+		p->flags |= PROP_WORD;
+	    if (value & 0x80) {
+		p->flags |= PROP_LONG;
+		if (track)
+		    mark_dependency ((zword) (prop_addr + 1));
+	    }
+	}
 
-	/* Get parent of object, and return if no parent */
+	/* Stop at the end of the list (or give up on a corrupt one) */
 
-	obj_addr += O4_PARENT;
-	LOW_WORD (obj_addr, parent)
-	if (!parent)
-	    return;
+	if (p->id == 0)
+	    break;
+	if (c->count > MAX_PROPERTIES)
+	    { p->id = 0; break; }
 
-	/* Get (older) sibling of object and set both parent and sibling
-	   pointers to 0 */
+	prop_addr = next_property (prop_addr);
 
-	SET_WORD (obj_addr, zero)
-	obj_addr += O4_SIBLING - O4_PARENT;
-	LOW_WORD (obj_addr, older_sibling)
-	SET_WORD (obj_addr, zero)
+    }
+
+    /* Fill in the slot table: property numbers from the number of an
+       entry up to the smallest number seen so far stop at that entry */
+
+    id = O4_PROPERTIES;
+
+    for (i = 0; i < c->count && id > 0; i++)
+	for (; id > c->props[i].id; id--)
+	    c->slot[id - 1] = i;
+
+    c->valid = track;
+
+}/* build_object_cache */
+
+
+/*
+ * object_cache
+ *
+ * Return the property cache entry of an object, building it if needed.
+ * Objects beyond the legal range (possible when errors are ignored)
+ * share a scratch entry that is rebuilt on every call.
+ *
+ */
+static obj_cache_t *object_cache (zword obj)
+{
+    obj_cache_t *c;
+
+    if (obj_cache == NULL || obj > max_cached_object)
+	c = &scratch_cache;
+    else
+	c = obj_cache + obj;
+
+    if (!c->valid)
+	build_object_cache (c, obj);
+
+    return c;
+
+}/* object_cache */
+
+
+/*
+ * find_property
+ *
+ * Return the cache entry of the first property whose number is not
+ * greater than the given one. This is the property itself if the
+ * object has it, otherwise the entry the list scan stopped at.
+ *
+ */
+static prop_entry_t *find_property (zword obj, zword prop)
+{
+    obj_cache_t *c = object_cache (obj);
 
-	/* Get first child of parent (the youngest sibling of the object) */
+    if (prop >= O4_PROPERTIES)
+	prop = O4_PROPERTIES - 1;
 
-	parent_addr = object_address (parent) + O4_CHILD;
-	LOW_WORD (parent_addr, younger_sibling)
+    return c->props + c->slot[prop];
 
-	/* Remove object from the list of siblings */
+}/* find_property */
+
+
+/*
+ * default_property
+ *
+ * Return the default value of a property.
+ *
+ */
+static zword default_property (zword prop)
+{
+    zword addr;
+    zword value;
+    int i;
+
+    if (prop == 0 || prop > max_property || prop_deps == NULL) {
+
+	addr = h_objects + 2 * (prop - 1);
+	LOW_WORD (addr, value)
+
+	return value;
+
+    }
+
+    if (!defaults_valid) {
+
+	for (i = 1, addr = h_objects; i <= max_property; i++, addr += 2) {
+
+	    LOW_WORD (addr, prop_defaults[i])
+
+	    mark_dependency (addr);
+	    mark_dependency ((zword) (addr + 1));
 
-	if (younger_sibling == object)
-	    SET_WORD (parent_addr, older_sibling)
-	else {
-	    do {
-		sibling_addr = object_address (younger_sibling) + O4_SIBLING;
-		LOW_WORD (sibling_addr, younger_sibling)
-	    } while (younger_sibling != object);
-	    SET_WORD (sibling_addr, older_sibling)
 	}
 
+	defaults_valid = TRUE;
+
     }
 
+    return prop_defaults[prop];
+
+}/* default_property */
+
+
+/*
+ * unlink_v3
+ *
+ * Unlink an object from its parent and siblings (V1-3, byte links).
+ *
+ */
+static void unlink_v3 (zword object)
+{
+    zbyte *obj;
+    zbyte *link;
+    zbyte parent;
+    zbyte younger_sibling;
+    zbyte older_sibling;
+
+    obj = zmp + O1_ADDR (object);
+
+    /* Get parent of object, and return if no parent */
+
+    parent = obj[O1_PARENT];
+    if (!parent)
+	return;
+
+    /* Get (older) sibling of object and set both parent and sibling
+       pointers to 0 */
+
+    obj[O1_PARENT] = 0;
+    older_sibling = obj[O1_SIBLING];
+    obj[O1_SIBLING] = 0;
+
+    /* Get first child of parent (the youngest sibling of the object) */
+
+    link = zmp + O1_ENTRY (parent) + O1_CHILD;
+    younger_sibling = *link;
+
+    /* Remove object from the list of siblings */
+
+    while (younger_sibling != object) {
+	link = zmp + O1_ENTRY (younger_sibling) + O1_SIBLING;
+	younger_sibling = *link;
+    }
+
+    *link = older_sibling;
+
+}/* unlink_v3 */
+
+
+/*
+ * unlink_v4
+ *
+ * Unlink an object from its parent and siblings (V4+, word links).
+ *
+ */
+static void unlink_v4 (zword object)
+{
+    zbyte *obj;
+    zbyte *link;
+    zword parent;
+    zword younger_sibling;
+    zword older_sibling;
+
+    obj = zmp + O4_ADDR (object);
+
+    /* Get parent of object, and return if no parent */
+
+    parent = load_word (obj + O4_PARENT);
+    if (!parent)
+	return;
+
+    /* Get (older) sibling of object and set both parent and sibling
+       pointers to 0 */
+
+    store_word (obj + O4_PARENT, 0);
+    older_sibling = load_word (obj + O4_SIBLING);
+    store_word (obj + O4_SIBLING, 0);
+
+    /* Get first child of parent (the youngest sibling of the object) */
+
+    link = zmp + O4_ADDR (parent) + O4_CHILD;
+    younger_sibling = load_word (link);
+
+    /* Remove object from the list of siblings */
+
+    while (younger_sibling != object) {
+	link = zmp + O4_ADDR (younger_sibling) + O4_SIBLING;
+	younger_sibling = load_word (link);
+    }
+
+    store_word (link, older_sibling);
+
+}/* unlink_v4 */
+
+
+/*
+ * unlink_object
+ *
+ * Unlink an object from its parent and siblings.
+ *
+ */
+static void unlink_object (zword object)
+{
+    if (object == 0) {
+	runtime_error (ERR_REMOVE_OBJECT_0);
+	return;
+    }
+
+    if (h_version <= V3)
+	unlink_v3 (object);
+    else
+	unlink_v4 (object);
+
 }/* unlink_object */
 
 
@@ -437,6 +811,7 @@ void z_get_child (void)
  */
 void z_get_next_prop (void)
 {
+    prop_entry_t *p;
     zword prop_addr;
     zbyte value;
     zbyte mask;
@@ -447,34 +822,44 @@ void z_get_next_prop (void)
 	return;
     }
 
-    /* Property id is in bottom five (six) bits */
-
-    mask = (h_version <= V3) ? 0x1f : 0x3f;
+    /* Load the first property */
 
-    /* Load address of first property */
-
-    prop_addr = first_property (zargs[0]);
+    p = object_cache (zargs[0])->props;
 
     if (zargs[1] != 0) {
 
 	/* Scan down the property list */
 
-	do {
-	    LOW_BYTE (prop_addr, value)
-	    prop_addr = next_property (prop_addr);
-	} while ((value & mask) > zargs[1]);
+	p = find_property (zargs[0], zargs[1]);
 
 	/* Exit if the property does not exist */
 
-	if ((value & mask) != zargs[1])
+	if (p->id != zargs[1]) {
+
 	    runtime_error (ERR_NO_PROP);
 
+	    /* Ran off the end of the list, look past the terminator */
+
+	    if (p->id == 0) {
+
+		mask = (h_version <= V3) ? 0x1f : 0x3f;
+
+		prop_addr = next_property (p->addr);
+		LOW_BYTE (prop_addr, value)
+		store ((zword) (value & mask));
+		return;
+
+	    }
+
+	}
+
+	p++;
+
     }
 
     /* Return the property id */
 
-    LOW_BYTE (prop_addr, value)
-    store ((zword) (value & mask));
+    store (p->id);
 
 }/* z_get_next_prop */
 
@@ -546,11 +931,10 @@ void z_get_parent (void)
  */
 void z_get_prop (void)
 {
+    prop_entry_t *p;
     zword prop_addr;
     zword wprop_val;
     zbyte bprop_val;
-    zbyte value;
-    zbyte mask;
 
     if (zargs[0] == 0) {
 	runtime_error (ERR_GET_PROP_0);
@@ -558,30 +942,17 @@ void z_get_prop (void)
 	return;
     }
 
-    /* Property id is in bottom five (six) bits */
-
-    mask = (h_version <= V3) ? 0x1f : 0x3f;
-
-    /* Load address of first property */
-
-    prop_addr = first_property (zargs[0]);
-
     /* Scan down the property list */
 
-    for (;;) {
-	LOW_BYTE (prop_addr, value)
-	if ((value & mask) <= zargs[1])
-	    break;
-	prop_addr = next_property (prop_addr);
-    }
+    p = find_property (zargs[0], zargs[1]);
 
-    if ((value & mask) == zargs[1]) {	/* property found */
+    if (p->id == zargs[1]) {	/* property found */
 
 	/* Load property (byte or word sized) */
 
-	prop_addr++;
+	prop_addr = p->addr + 1;
 
-	if ((h_version <= V3 && !(value & 0xe0)) || (h_version >= V4 && !(value & 0xc0))) {
+	if (!(p->flags & PROP_WORD)) {
 
 	    LOW_BYTE (prop_addr, bprop_val)
 	    wprop_val = bprop_val;
@@ -592,8 +963,7 @@ void z_get_prop (void)
 
 	/* Load default value */
 
-	prop_addr = h_objects + 2 * (zargs[1] - 1);
-	LOW_WORD (prop_addr, wprop_val)
+	wprop_val = default_property (zargs[1]);
 
     }
 
@@ -613,9 +983,7 @@ void z_get_prop (void)
  */
 void z_get_prop_addr (void)
 {
-    zword prop_addr;
-    zbyte value;
-    zbyte mask;
+    prop_entry_t *p;
 
     if (zargs[0] == 0) {
 	runtime_error (ERR_GET_PROP_ADDR_0);
@@ -627,32 +995,16 @@ void z_get_prop_addr (void)
 	if (zargs[0] > MAX_OBJECT)
 	    { store (0); return; }
 
-    /* Property id is in bottom five (six) bits */
-
-    mask = (h_version <= V3) ? 0x1f : 0x3f;
-
-    /* Load address of first property */
-
-    prop_addr = first_property (zargs[0]);
-
     /* Scan down the property list */
 
-    for (;;) {
-	LOW_BYTE (prop_addr, value)
-	if ((value & mask) <= zargs[1])
-	    break;
-	prop_addr = next_property (prop_addr);
-    }
+    p = find_property (zargs[0], zargs[1]);
 
     /* Calculate the property address or return zero */
 
-    if ((value & mask) == zargs[1]) {
-
-	if (h_version >= V4 && (value & 0x80))
-	    prop_addr++;
-	store ((zword) (prop_addr + 1));
-
-    } else store (0);
+    if (p->id == zargs[1])
+	store ((zword) (p->addr + ((p->flags & PROP_LONG) ? 2 : 1)));
+    else
+	store (0);
 
 }/* z_get_prop_addr */
 
@@ -673,23 +1025,9 @@ void z_get_prop_len (void)
     addr = zargs[0] - 1;
     LOW_BYTE (addr, value)
 
-    /* Calculate length of property */
-
-    if (h_version <= V3)
-	value = (value >> 5) + 1;
-    else if (!(value & 0x80))
-	value = (value >> 6) + 1;
-    else {
-
-	value &= 0x3f;
-
-	if (value == 0) value = 64;	/* demanded by Spec 1.0 */
-
-    }
-
     /* Store length of property */
 
-    store (value);
+    store (prop_length[value]);
 
 }/* z_get_prop_len */
 
@@ -831,42 +1169,33 @@ void z_insert_obj (void)
  */
 void z_put_prop (void)
 {
+    prop_entry_t *p;
     zword prop_addr;
-    zword value;
-    zbyte mask;
 
     if (zargs[0] == 0) {
 	runtime_error (ERR_PUT_PROP_0);
 	return;
     }
 
-    /* Property id is in bottom five or six bits */
-
-    mask = (h_version <= V3) ? 0x1f : 0x3f;
-
-    /* Load address of first property */
-
-    prop_addr = first_property (zargs[0]);
-
     /* Scan down the property list */
 
-    for (;;) {
-	LOW_BYTE (prop_addr, value)
-	if ((value & mask) <= zargs[1])
-	    break;
-	prop_addr = next_property (prop_addr);
-    }
+    p = find_property (zargs[0], zargs[1]);
 
     /* Exit if the property does not exist */
 
-    if ((value & mask) != zargs[1])
+    if (p->id != zargs[1])
 	runtime_error (ERR_NO_PROP);
 
     /* Store the new property value (byte or word sized) */
 
-    prop_addr++;
+    prop_addr = p->addr + 1;
+
+    /* A long property is written over its second size byte */
+
+    if (p->flags & PROP_LONG)
+	reset_object_cache ();
 
-    if ((h_version <= V3 && !(value & 0xe0)) || (h_version >= V4 && !(value & 0xc0))) {
+    if (!(p->flags & PROP_WORD)) {
 	zbyte v = zargs[2];
 	SET_BYTE (prop_addr, v)
     } else {
@@ -1000,3 +1329,281 @@ void z_test_attr (void)
     branch (value & (0x80 >> (zargs[1] & 7)));
 
 }/* z_test_attr */
+
+
+/*
+ * The handlers below replace the generic object tree and attribute
+ * opcodes once the story file is loaded. They are specialised for the
+ * byte links of V1-3 and the word links of V4+, and leave anything out
+ * of the ordinary (object 0, illegal objects and attributes, tracing)
+ * to the generic versions above.
+ */
+
+static void z_get_parent_v3 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > 255)
+	{ z_get_parent (); return; }
+
+    store (zmp[O1_ENTRY (zargs[0]) + O1_PARENT]);
+
+}/* z_get_parent_v3 */
+
+
+static void z_get_parent_v4 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > MAX_OBJECT)
+	{ z_get_parent (); return; }
+
+    store (load_word (zmp + O4_ADDR (zargs[0]) + O4_PARENT));
+
+}/* z_get_parent_v4 */
+
+
+static void z_get_child_v3 (void)
+{
+    zbyte child;
+
+    if (zargs[0] == 0 || zargs[0] > 255)
+	{ z_get_child (); return; }
+
+    child = zmp[O1_ENTRY (zargs[0]) + O1_CHILD];
+
+    store (child);
+    branch (child);
+
+}/* z_get_child_v3 */
+
+
+static void z_get_child_v4 (void)
+{
+    zword child;
+
+    if (zargs[0] == 0 || zargs[0] > MAX_OBJECT)
+	{ z_get_child (); return; }
+
+    child = load_word (zmp + O4_ADDR (zargs[0]) + O4_CHILD);
+
+    store (child);
+    branch (child);
+
+}/* z_get_child_v4 */
+
+
+static void z_get_sibling_v3 (void)
+{
+    zbyte sibling;
+
+    if (zargs[0] == 0 || zargs[0] > 255)
+	{ z_get_sibling (); return; }
+
+    sibling = zmp[O1_ENTRY (zargs[0]) + O1_SIBLING];
+
+    store (sibling);
+    branch (sibling);
+
+}/* z_get_sibling_v3 */
+
+
+static void z_get_sibling_v4 (void)
+{
+    zword sibling;
+
+    if (zargs[0] == 0 || zargs[0] > MAX_OBJECT)
+	{ z_get_sibling (); return; }
+
+    sibling = load_word (zmp + O4_ADDR (zargs[0]) + O4_SIBLING);
+
+    store (sibling);
+    branch (sibling);
+
+}/* z_get_sibling_v4 */
+
+
+static void z_jin_v3 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > 255)
+	{ z_jin (); return; }
+
+    branch (zmp[O1_ENTRY (zargs[0]) + O1_PARENT] == zargs[1]);
+
+}/* z_jin_v3 */
+
+
+static void z_jin_v4 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > MAX_OBJECT)
+	{ z_jin (); return; }
+
+    branch (load_word (zmp + O4_ADDR (zargs[0]) + O4_PARENT) == zargs[1]);
+
+}/* z_jin_v4 */
+
+
+static void z_insert_obj_v3 (void)
+{
+    zbyte *obj1;
+    zbyte *obj2;
+
+    if (zargs[0] == 0 || zargs[0] > 255 || zargs[1] == 0 || zargs[1] > 255)
+	{ z_insert_obj (); return; }
+
+    obj1 = zmp + O1_ENTRY (zargs[0]);
+    obj2 = zmp + O1_ENTRY (zargs[1]);
+
+    /* Remove object 1 from current parent */
+
+    unlink_v3 (zargs[0]);
+
+    /* Make object 1 first child of object 2 */
+
+    obj1[O1_PARENT] = (zbyte) zargs[1];
+    obj1[O1_SIBLING] = obj2[O1_CHILD];
+    obj2[O1_CHILD] = (zbyte) zargs[0];
+
+}/* z_insert_obj_v3 */
+
+
+static void z_insert_obj_v4 (void)
+{
+    zbyte *obj1;
+    zbyte *obj2;
+    zword child;
+
+    if (zargs[0] == 0 || zargs[0] > MAX_OBJECT || zargs[1] == 0 || zargs[1] > MAX_OBJECT)
+	{ z_insert_obj (); return; }
+
+    obj1 = zmp + O4_ADDR (zargs[0]);
+    obj2 = zmp + O4_ADDR (zargs[1]);
+
+    /* Remove object 1 from current parent */
+
+    unlink_v4 (zargs[0]);
+
+    /* Make object 1 first child of object 2 */
+
+    child = load_word (obj2 + O4_CHILD);
+
+    store_word (obj1 + O4_PARENT, zargs[1]);
+    store_word (obj2 + O4_CHILD, zargs[0]);
+    store_word (obj1 + O4_SIBLING, child);
+
+}/* z_insert_obj_v4 */
+
+
+static void z_test_attr_v3 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > 255 || zargs[1] > 31)
+	{ z_test_attr (); return; }
+
+    branch (zmp[O1_ENTRY (zargs[0]) + zargs[1] / 8] & (0x80 >> (zargs[1] & 7)));
+
+}/* z_test_attr_v3 */
+
+
+static void z_test_attr_v4 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > MAX_OBJECT || zargs[1] > 47)
+	{ z_test_attr (); return; }
+
+    branch (zmp[O4_ADDR (zargs[0]) + zargs[1] / 8] & (0x80 >> (zargs[1] & 7)));
+
+}/* z_test_attr_v4 */
+
+
+static void z_set_attr_v3 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > 255 || zargs[1] > 31)
+	{ z_set_attr (); return; }
+
+    zmp[O1_ENTRY (zargs[0]) + zargs[1] / 8] |= 0x80 >> (zargs[1] & 7);
+
+}/* z_set_attr_v3 */
+
+
+static void z_set_attr_v4 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > MAX_OBJECT || zargs[1] > 47)
+	{ z_set_attr (); return; }
+
+    zmp[O4_ADDR (zargs[0]) + zargs[1] / 8] |= 0x80 >> (zargs[1] & 7);
+
+}/* z_set_attr_v4 */
+
+
+static void z_clear_attr_v3 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > 255 || zargs[1] > 31)
+	{ z_clear_attr (); return; }
+
+    zmp[O1_ENTRY (zargs[0]) + zargs[1] / 8] &= ~(0x80 >> (zargs[1] & 7));
+
+}/* z_clear_attr_v3 */
+
+
+static void z_clear_attr_v4 (void)
+{
+    if (zargs[0] == 0 || zargs[0] > MAX_OBJECT || zargs[1] > 47)
+	{ z_clear_attr (); return; }
+
+    zmp[O4_ADDR (zargs[0]) + zargs[1] / 8] &= ~(0x80 >> (zargs[1] & 7));
+
+}/* z_clear_attr_v4 */
+
+
+/*
+ * select_object_opcodes
+ *
+ * Install the object opcode handlers that suit the story file. The
+ * generic handlers are used while any object or attribute tracing is
+ * switched on, so this must be called again whenever those options
+ * change.
+ *
+ */
+void select_object_opcodes (void)
+{
+    bool tracing = f_setup.attribute_assignment || f_setup.attribute_testing
+	|| f_setup.object_locating || f_setup.object_movement;
+
+    if (tracing) {
+
+	op1_opcodes[0x01] = z_get_sibling;
+	op1_opcodes[0x02] = z_get_child;
+	op1_opcodes[0x03] = z_get_parent;
+	var_opcodes[0x06] = z_jin;
+	var_opcodes[0x0a] = z_test_attr;
+	var_opcodes[0x0b] = z_set_attr;
+	var_opcodes[0x0c] = z_clear_attr;
+	var_opcodes[0x0e] = z_insert_obj;
+
+    } else if (h_version <= V3) {
+
+	op1_opcodes[0x01] = z_get_sibling_v3;
+	op1_opcodes[0x02] = z_get_child_v3;
+	op1_opcodes[0x03] = z_get_parent_v3;
+	var_opcodes[0x06] = z_jin_v3;
+	var_opcodes[0x0a] = z_test_attr_v3;
+	var_opcodes[0x0b] = z_set_attr_v3;
+	var_opcodes[0x0c] = z_clear_attr_v3;
+	var_opcodes[0x0e] = z_insert_obj_v3;
+
+    } else {
+
+	op1_opcodes[0x01] = z_get_sibling_v4;
+	op1_opcodes[0x02] = z_get_child_v4;
+	op1_opcodes[0x03] = z_get_parent_v4;
+	var_opcodes[0x06] = z_jin_v4;
+	var_opcodes[0x0a] = z_test_attr_v4;
+	var_opcodes[0x0b] = z_set_attr_v4;
+	var_opcodes[0x0c] = z_clear_attr_v4;
+	var_opcodes[0x0e] = z_insert_obj_v4;
+
+    }
+
+    /* Precompute the address of the (nonexistent) object 0 entry */
+
+    if (h_version <= V3)
+	obj_base = h_objects + 62 - O1_SIZE;
+    else
+	obj_base = h_objects + 126 - O4_SIZE;
+
+}/* select_object_opcodes */
@@ -18,6 +18,10 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "frotz.h"
 
 #ifdef DJGPP
@@ -30,6 +34,32 @@ int zargc;
 
 static int finished = 0;
 
+volatile sig_atomic_t tick_requested = 0;
+
+static long tick_interval = 0;
+static long tick_countdown = LONG_MAX;
+static long tick_armed = LONG_MAX;
+
+/* Instructions and processor time used since the turn started, and
+   the wall clock when it started; the clocks stop when it ends */
+
+static long turn_instructions = 0;
+static clock_t turn_started = 0;
+static clock_t turn_ended = 0;
+static long turn_wall_started = 0;
+static long turn_wall_ended = 0;
+static bool in_turn = FALSE;
+
+static budget_hook_t budget_hook = NULL;
+
+static int depth = 0;
+
+#ifndef BUDGET_CLOCK_INTERVAL
+#define BUDGET_CLOCK_INTERVAL 65536
+#endif
+
+extern int restore_undo (void);
+
 static void __extended__ (void);
 static void __illegal__ (void);
 
@@ -247,6 +277,359 @@ static void load_all_operands (zbyte specifier)
 }/* load_all_operands */
 
 
+/*
+ * arm
+ *
+ * Set the countdown to the next tick: when the interface wants one,
+ * when the instruction budget runs out, or when it is time to look at
+ * the clock.
+ *
+ */
+static void arm (void)
+{
+    long n = tick_interval > 0 ? tick_interval : LONG_MAX;
+
+    if (f_setup.turn_instructions > 0) {
+	long left = f_setup.turn_instructions - turn_instructions;
+	if (left < n)
+	    n = left > 0 ? left : 1;
+    }
+
+    if (f_setup.max_instructions > 0) {
+	long left = f_setup.max_instructions - usage.instructions - turn_instructions;
+	if (left < n)
+	    n = left > 0 ? left : 1;
+    }
+
+    if ((f_setup.turn_time > 0 || f_setup.max_cpu_time > 0
+	 || f_setup.max_turn_wall_time > 0)
+	&& n > BUDGET_CLOCK_INTERVAL)
+	n = BUDGET_CLOCK_INTERVAL;
+
+    tick_countdown = tick_armed = n;
+
+}/* arm */
+
+
+/*
+ * set_tick_interval
+ *
+ * Have os_tick called every n instructions, or only when tick_requested
+ * is set if n is zero.
+ *
+ */
+void set_tick_interval (long n)
+{
+    turn_instructions += tick_armed - tick_countdown;
+    tick_interval = n;
+
+    arm ();
+
+}/* set_tick_interval */
+
+
+/*
+ * set_budget_hook
+ *
+ * Have the given function decide what happens when a turn runs out of
+ * its budget. Without one, the interpreter stops with an error.
+ *
+ */
+void set_budget_hook (budget_hook_t hook)
+{
+    budget_hook = hook;
+
+}/* set_budget_hook */
+
+
+/*
+ * reset_budget
+ *
+ * Start counting the instructions and processor time of the turn from
+ * zero again.
+ *
+ */
+static void reset_budget (void)
+{
+    turn_instructions = 0;
+    turn_started = clock ();
+
+    arm ();
+
+}/* reset_budget */
+
+
+/*
+ * start_turn
+ *
+ * Give the game a fresh budget. This happens whenever input arrives.
+ *
+ */
+void start_turn (void)
+{
+    end_turn ();
+
+    in_turn = TRUE;
+    turn_wall_started = wall_ms ();
+
+    reset_budget ();
+
+}/* start_turn */
+
+
+/*
+ * end_turn
+ *
+ * Add the turn to the session totals and count nothing until the next
+ * one starts. This happens whenever the game waits for input, so that
+ * the wait is not counted.
+ *
+ */
+void end_turn (void)
+{
+    long instructions, ms, wall;
+
+    if (!in_turn)
+	return;
+
+    turn_ended = clock ();
+    turn_wall_ended = wall_ms ();
+    in_turn = FALSE;
+
+    instructions = turn_usage (&ms, &wall);
+    usage_end_turn (instructions, ms, wall);
+
+    reset_budget ();
+    turn_ended = turn_started;
+    turn_wall_ended = turn_wall_started;
+
+}/* end_turn */
+
+
+/*
+ * turn_usage
+ *
+ * Return the number of instructions executed in this turn so far, and
+ * store the processor time and the wall time it took in milliseconds.
+ *
+ */
+long turn_usage (long *ms, long *wall)
+{
+    if (ms != NULL)
+	*ms = (long) (((in_turn ? clock () : turn_ended) - turn_started)
+		      * 1000.0 / CLOCKS_PER_SEC);
+    if (wall != NULL)
+	*wall = (in_turn ? wall_ms () : turn_wall_ended) - turn_wall_started;
+
+    return turn_instructions + tick_armed - tick_countdown;
+
+}/* turn_usage */
+
+
+/*
+ * call_stack
+ *
+ * Store the current PC followed by the return address of each routine
+ * call in progress, innermost first, and return how many were stored.
+ *
+ */
+int call_stack (long *pcs, int max)
+{
+    zword *frame = fp;
+    zword frames = frame_count;
+    long pc;
+    int n = 0;
+
+    GET_PC (pc)
+
+    if (max > 0)
+	pcs[n++] = pc;
+
+    while (n < max && frames-- > 0 && frame < stack + STACK_SIZE - 3) {
+	pcs[n++] = ((long) frame[3] << 9) | frame[2];
+	frame = stack + 1 + frame[1];
+    }
+
+    return n;
+
+}/* call_stack */
+
+
+/*
+ * budget_exceeded
+ *
+ * The turn has run out of its budget. Describe where the game is and
+ * let the hook decide whether to go on, take back the turn or stop.
+ *
+ */
+static void budget_exceeded (void)
+{
+    char report[256];
+    long instructions, ms;
+    long pcs[8];
+    int count, i, len;
+    int action;
+
+    instructions = turn_usage (&ms, NULL);
+    count = call_stack (pcs, 8);
+
+    /* Two numbers and eight addresses fit even with 64 bit longs */
+
+    len = sprintf (report,
+		   "Turn budget exceeded after %ld instructions and %ld ms (PC = %lx",
+		   instructions, ms, count > 0 ? pcs[0] : 0L);
+
+    for (i = 1; i < count; i++)
+	len += sprintf (report + len, i == 1 ? ", called from %lx" : " %lx", pcs[i]);
+
+    strcpy (report + len, ")");
+
+    action = budget_hook != NULL ? budget_hook (report) : BUDGET_QUIT;
+
+    /* The turn goes on without input, so it is not finished; only the
+       instructions it used so far are kept for the session */
+
+    usage.instructions += instructions;
+
+    /* Taking back the turn restores the last undo state, which only
+       works from the outermost interpreter loop and only with games
+       that expect @restore_undo to return to @save_undo */
+
+    if (action == BUDGET_UNDO) {
+	if (depth == 1 && h_version >= V5 && restore_undo () > 0) {
+	    store (2);
+	    reset_budget ();
+	    return;
+	}
+	action = BUDGET_QUIT;
+    }
+
+    if (action == BUDGET_QUIT)
+	os_fatal (report);
+
+    reset_budget ();
+
+}/* budget_exceeded */
+
+
+/*
+ * tick
+ *
+ * Give the interface its turn between two instructions, and check the
+ * budget of the turn and the limits of the session.
+ *
+ */
+static void tick (void)
+{
+    long ms = 0;
+
+    turn_instructions += tick_armed - tick_countdown;
+    tick_requested = 0;
+
+    arm ();
+
+    os_tick ();
+
+    if (f_setup.turn_time > 0)
+	turn_usage (&ms, NULL);
+
+    if ((f_setup.turn_instructions > 0 && turn_instructions >= f_setup.turn_instructions)
+	|| (f_setup.turn_time > 0 && ms >= f_setup.turn_time))
+	budget_exceeded ();
+
+    if (f_setup.max_instructions > 0 || f_setup.max_cpu_time > 0
+	|| f_setup.max_turn_wall_time > 0)
+	usage_check ();
+
+}/* tick */
+
+
+/*
+ * trace_loop
+ *
+ * The interpreter loop while an instruction trace is kept. It works
+ * like the one in interpret, but records each instruction with what
+ * it stored and the condition it branched on.
+ *
+ */
+static void trace_loop (void)
+{
+    long mark = trace_mark ();
+
+    do {
+
+	void (*op) (void);
+	zword *frame;
+	long after;
+	zbyte opcode;
+
+	trace_begin ();
+
+	CODE_BYTE (opcode)
+
+	zargc = 0;
+
+	if (opcode < 0x80) {			/* 2OP opcodes */
+
+	    load_operand ((zbyte) (opcode & 0x40) ? 2 : 1);
+	    load_operand ((zbyte) (opcode & 0x20) ? 2 : 1);
+
+	    op = var_opcodes[opcode & 0x1f];
+
+	} else if (opcode < 0xb0) {		/* 1OP opcodes */
+
+	    load_operand ((zbyte) (opcode >> 4));
+
+	    op = op1_opcodes[opcode & 0x0f];
+
+	} else if (opcode < 0xc0) {		/* 0OP opcodes */
+
+	    op = op0_opcodes[opcode - 0xb0];
+
+	} else {				/* VAR opcodes */
+
+	    zbyte specifier1;
+	    zbyte specifier2;
+
+	    if (opcode == 0xec || opcode == 0xfa) {
+		CODE_BYTE (specifier1)
+		CODE_BYTE (specifier2)
+		load_all_operands (specifier1);
+		load_all_operands (specifier2);
+	    } else {
+		CODE_BYTE (specifier1)
+		load_all_operands (specifier1);
+	    }
+
+	    op = var_opcodes[opcode - 0xc0];
+
+	}
+
+	/* The store variable and the branch, if any, come next; what
+	   they got is read back once the opcode has run */
+
+	GET_PC (after)
+	frame = fp;
+
+	op ();
+
+	trace_result (after, frame);
+
+#if defined(DJGPP) && defined(SOUND_SUPPORT)
+        if (end_of_sound_flag)
+            end_of_sound ();
+#endif
+
+	if (--tick_countdown == 0 || tick_requested)
+	    tick ();
+
+    } while (finished == 0);
+
+    trace_return (mark);
+
+}/* trace_loop */
+
+
 /*
  * interpret
  *
@@ -261,6 +644,16 @@ void interpret (void)
 	f_setup.restore_mode=0;
     }
 
+    if (depth++ == 0)
+	start_turn ();
+
+    if (tracing) {
+	trace_loop ();
+	finished--;
+	depth--;
+	return;
+    }
+
     do {
 
 	zbyte opcode;
@@ -310,10 +703,13 @@ void interpret (void)
             end_of_sound ();
 #endif
 
-        os_tick();
+	if (--tick_countdown == 0 || tick_requested)
+	    tick ();
+
     } while (finished == 0);
 
     finished--;
+    depth--;
 
 }/* interpret */
 
@@ -23,12 +23,14 @@
 #define MAX_NESTING 16
 
 extern zword get_max_width (zword);
+extern void memory_written (zword, zword);
 
 static int depth = -1;
 
 static struct {
     zword xsize;
     zword table;
+    zword size;
     zword width;
     zword total;
 } redirect[MAX_NESTING];
@@ -56,6 +58,7 @@ void memory_open (zword table, zword xsize, bool buffering)
 	storew (table, 0);
 
 	redirect[depth].table = table;
+	redirect[depth].size = 0;
 	redirect[depth].width = 0;
 	redirect[depth].total = 0;
 	redirect[depth].xsize = xsize;
@@ -81,10 +84,8 @@ void memory_new_line (void)
     redirect[depth].total += redirect[depth].width;
     redirect[depth].width = 0;
 
-    addr = redirect[depth].table;
-
-    LOW_WORD (addr, size)
-    addr += 2;
+    addr = redirect[depth].table + 2;
+    size = redirect[depth].size;
 
     if (redirect[depth].xsize != 0xffff) {
 
@@ -93,6 +94,8 @@ void memory_new_line (void)
 
     } else storeb ((zword) (addr + (size++)), 13);
 
+    redirect[depth].size = size;
+
     storew (redirect[depth].table, size);
 
 }/* memory_new_line */
@@ -103,11 +106,17 @@ void memory_new_line (void)
  *
  * Redirect a string of characters to the memory of the Z-machine.
  *
+ * The length of the table is kept in redirect[], so the characters can
+ * go straight into memory once the whole word is known to fit; storeb
+ * is only needed (and reports the error) if it does not.
+ *
  */
 void memory_word (const zchar *s)
 {
     zword size;
     zword addr;
+    zword start;
+    long length;
     zchar c;
 
     if (h_version == V6) {
@@ -129,13 +138,31 @@ void memory_word (const zchar *s)
 
     }
 
-    addr = redirect[depth].table;
+    addr = redirect[depth].table + 2;
+    size = redirect[depth].size;
+
+    for (length = 0; s[length] != 0; length++)
+	;
+
+    start = addr + size;
+
+    if (start + length <= h_dynamic_size) {
+
+	zbyte *p = zmp + start;
+
+	while ((c = *s++) != 0)
+	    *p++ = (c >= 0x20 && c <= 0x7e) ? c : translate_to_zscii (c);
+
+	memory_written (start, length);
+
+	size += length;
+
+    } else
 
-    LOW_WORD (addr, size)
-    addr += 2;
+	while ((c = *s++) != 0)
+	    storeb ((zword) (addr + (size++)), translate_to_zscii (c));
 
-    while ((c = *s++) != 0)
-	storeb ((zword) (addr + (size++)), translate_to_zscii (c));
+    redirect[depth].size = size;
 
     storew (redirect[depth].table, size);
 
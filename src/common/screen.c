@@ -18,6 +18,8 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <stdlib.h>
+#include <string.h>
 #include "frotz.h"
 
 extern void set_header_extension (int, zword);
@@ -54,6 +56,16 @@ static Zwindow wp[8], *cwp = wp;
 
 Zwindow * curwinrec() { return cwp;}
 
+/* How text is measured; the interface may change this in os_init_screen */
+int text_width_mode = WIDTH_STRING;
+
+/* Font and style of the text most recently sent to the interface */
+static int text_font = TEXT_FONT;
+static int text_style = 0;
+
+/* Character widths by font and style (0xff = not measured yet) */
+static zbyte *width_cache[8][16];
+
 
 /*
  * winarg0
@@ -104,7 +116,7 @@ static zword winarg2 (void)
  */
 static void update_cursor (void)
 {
-    os_set_cursor (
+    batch_set_cursor (
 	cwp->y_pos + cwp->y_cursor - 1,
 	cwp->x_pos + cwp->x_cursor - 1);
 
@@ -162,6 +174,142 @@ static int units_left (void)
 }/* units_left */
 
 
+/*
+ * reset_widths
+ *
+ * Forget all measured character widths.
+ *
+ */
+static void reset_widths (void)
+{
+    int i, j;
+
+    for (i = 0; i < 8; i++)
+	for (j = 0; j < 16; j++) {
+	    free (width_cache[i][j]);
+	    width_cache[i][j] = NULL;
+	}
+
+}/* reset_widths */
+
+
+/*
+ * char_width
+ *
+ * Return the width of a character in the given font and style. Each
+ * width is only measured once; zchar is a byte, so a table of 256
+ * widths per font and style covers every character.
+ *
+ */
+static int char_width (zchar c, int font, int style)
+{
+    zbyte *widths;
+    int width;
+
+    if (text_width_mode == WIDTH_FIXED)
+	return 1;
+    if (text_width_mode == WIDTH_STRING)
+	return os_char_width (c);
+
+    widths = width_cache[font & 7][style & 15];
+
+    if (widths == NULL) {
+
+	if ((widths = malloc (256)) == NULL)
+	    return os_char_width (c);
+
+	memset (widths, 0xff, 256);
+	width_cache[font & 7][style & 15] = widths;
+
+    }
+
+    if (widths[c] == 0xff) {
+
+	if ((width = os_char_width (c)) >= 0xff)
+	    return width;
+
+	widths[c] = width;
+
+    }
+
+    return widths[c];
+
+}/* char_width */
+
+
+/*
+ * string_width
+ *
+ * Return the width of a string, which may contain font and style
+ * changes. Unless the interface has to measure whole strings itself,
+ * this adds up the (cached) character widths, and reports the font and
+ * style in effect at the end of the string if asked to.
+ *
+ */
+static int string_width (const zchar *s, int *font, int *style)
+{
+    const zchar *start = s;
+    int f = text_font;
+    int st = text_style;
+    int width = 0;
+    zchar c;
+
+    if (text_width_mode == WIDTH_STRING && font == NULL)
+	return os_string_width (s);
+
+    while ((c = *s++) != 0)
+
+	if (c == ZC_NEW_FONT)
+	    f = *s++;
+	else if (c == ZC_NEW_STYLE)
+	    st = *s++;
+	else if (text_width_mode != WIDTH_STRING)
+	    width += char_width (c, f, st);
+
+    if (font != NULL) {
+	*font = f;
+	*style = st;
+    }
+
+    return (text_width_mode == WIDTH_STRING) ? os_string_width (start) : width;
+
+}/* string_width */
+
+
+/*
+ * set_font
+ *
+ * Send a font change to the interface.
+ *
+ */
+static void set_font (int font)
+{
+    text_font = font;
+    batch_set_font (font);
+
+    if (cwin == 0)
+	scrollback_attribute (ZC_NEW_FONT, font);
+
+}/* set_font */
+
+
+/*
+ * set_text_style
+ *
+ * Send a text style change to the interface.
+ *
+ */
+static void set_text_style (int style)
+{
+    text_style = style;
+    batch_set_text_style (style);
+
+    if (cwin == 0)
+	scrollback_attribute (ZC_NEW_STYLE, style);
+
+}/* set_text_style */
+
+
 /*
  * get_max_width
  *
@@ -226,6 +374,9 @@ void screen_new_line (void)
 
     cwp->x_cursor = cwp->left + 1;
 
+    if (cwin == 0)
+	scrollback_new_line ();
+
     os_font_data(0, &font_height, &font_width);
     if (cwp->y_cursor + 2 * font_height - 1 > cwp->y_size)
 
@@ -234,7 +385,7 @@ void screen_new_line (void)
 	    zword y = cwp->y_pos;
 	    zword x = cwp->x_pos;
 
-	    os_scroll_area (y,
+	    batch_scroll_area (y,
 			    x,
 			    y + cwp->y_size - 1,
 			    x + cwp->x_size - 1,
@@ -258,8 +409,10 @@ void screen_new_line (void)
 
 	if ((short) cwp->line_count >= (short) above + below - 1) {
 
-	    if (more_prompts)
+	    if (more_prompts) {
+		batch_flush ();
 		os_more_prompt ();
+	    }
 
 	    cwp->line_count = f_setup.context_lines;
 
@@ -291,7 +444,7 @@ void screen_char (zchar c)
     if (c == ZC_INDENT && cwp->x_cursor != cwp->left + 1)
 	c = ' ';
 
-    if (units_left () < (width = os_char_width (c))) {
+    if (units_left () < (width = char_width (c, text_font, text_style))) {
 
 	if (!enable_wrapping)
 	    { cwp->x_cursor = cwp->x_size - cwp->right; return; }
@@ -300,7 +453,10 @@ void screen_char (zchar c)
 
     }
 
-    os_display_char (c); cwp->x_cursor += width;
+    batch_display_char (c); cwp->x_cursor += width;
+
+    if (cwin == 0)
+	scrollback_char (c);
 
 }/* screen_char */
 
@@ -316,13 +472,15 @@ void screen_char (zchar c)
 void screen_word (const zchar *s)
 {
     int width;
+    int font;
+    int style;
 
     if (discarding) return;
 
     if (*s == ZC_INDENT && cwp->x_cursor != cwp->left + 1)
 	screen_char (*s++);
 
-    if (units_left () < (width = os_string_width (s))) {
+    if (units_left () < (width = string_width (s, &font, &style))) {
 
 	if (!enable_wrapping) {
 
@@ -335,9 +493,9 @@ void screen_word (const zchar *s)
 		    int arg = (int) *s++;
 
 		    if (c == ZC_NEW_FONT)
-			os_set_font (arg);
+			set_font (arg);
 		    if (c == ZC_NEW_STYLE)
-			os_set_text_style (arg);
+			set_text_style (arg);
 
 		} else screen_char (c);
 
@@ -345,8 +503,16 @@ void screen_word (const zchar *s)
 
 	}
 
-	if (*s == ' ' || *s == ZC_INDENT || *s == ZC_GAP)
-	    width = os_string_width (++s);
+	if (*s == ' ' || *s == ZC_INDENT || *s == ZC_GAP) {
+
+	    /* Drop the leading space; no need to measure the rest again */
+
+	    if (text_width_mode == WIDTH_STRING)
+		width = os_string_width (++s);
+	    else
+		width -= char_width (*s++, text_font, text_style);
+
+	}
 
 #ifdef AMIGA
 	if (cwin == 0) Justifiable ();
@@ -356,7 +522,13 @@ void screen_word (const zchar *s)
 
     }
 
-    os_display_string (s); cwp->x_cursor += width;
+    batch_display_string (s); cwp->x_cursor += width;
+
+    if (cwin == 0)
+	scrollback_string (s);
+
+    text_font = font;
+    text_style = style;
 
 }/* screen_word */
 
@@ -371,10 +543,15 @@ void screen_write_input (const zchar *buf, zchar key)
 {
     int width;
 
-    if (units_left () < (width = os_string_width (buf)))
+    if (units_left () < (width = string_width (buf, NULL, NULL)))
 	screen_new_line ();
 
-    os_display_string (buf); cwp->x_cursor += width;
+    batch_display_string (buf); cwp->x_cursor += width;
+
+    /* A line redrawn by console_read_input is kept once it is finished */
+
+    if (cwin == 0 && key != (zchar) -1)
+	scrollback_string (buf);
 
     if (key == ZC_RETURN)
 	screen_new_line ();
@@ -394,7 +571,7 @@ void screen_erase_input (const zchar *buf)
 {
     if (buf[0] != 0) {
 
-	int width = os_string_width (buf);
+	int width = string_width (buf, NULL, NULL);
 
 	zword y;
 	zword x;
@@ -405,8 +582,8 @@ void screen_erase_input (const zchar *buf)
 	x = cwp->x_pos + cwp->x_cursor - 1;
 
 	os_font_data(0, &font_height, &font_width);
-	os_erase_area (y, x, y + font_height - 1, x + width - 1, -1);
-	os_set_cursor (y, x);
+	batch_erase_area (y, x, y + font_height - 1, x + width - 1, -1);
+	batch_set_cursor (y, x);
 
     }
 
@@ -426,7 +603,7 @@ zchar console_read_input (int max, zchar *buf, zword timeout, bool continued)
 
     /* Make sure there is some space for input */
 
-    if (cwin == 0 && units_left () + os_string_width (buf) < 10 * font_width)
+    if (cwin == 0 && units_left () + string_width (buf, NULL, NULL) < 10 * font_width)
 	screen_new_line ();
 
     /* Make sure the input line is visible */
@@ -439,14 +616,18 @@ zchar console_read_input (int max, zchar *buf, zword timeout, bool continued)
 
     /* Get input line from IO interface */
 
-    cwp->x_cursor -= os_string_width (buf);
+    cwp->x_cursor -= string_width (buf, NULL, NULL);
+    batch_flush ();
     key = os_read_line (max, buf, timeout, units_left (), continued);
-    cwp->x_cursor += os_string_width (buf);
+    cwp->x_cursor += string_width (buf, NULL, NULL);
 
     if (key != ZC_TIME_OUT)
 	for (i = 0; i < 8; i++)
 	    wp[i].line_count = 0;
 
+    if (key != ZC_TIME_OUT && cwin == 0)
+	scrollback_string (buf);
+
     /* Add a newline if the input was terminated normally */
 
     if (key == ZC_RETURN)
@@ -468,6 +649,7 @@ zchar console_read_key (zword timeout)
     zchar key;
     int i;
 
+    batch_flush ();
     key = os_read_key (timeout, cursor);
 
     if (key != ZC_TIME_OUT)
@@ -533,7 +715,7 @@ void refresh_text_style (void)
 	print_char (ZC_NEW_STYLE);
 	print_char (style);
 
-    } else os_set_text_style (style);
+    } else set_text_style (style);
 
 }/* refresh_text_style */
 
@@ -555,12 +737,12 @@ static void set_window (zword win)
 
     if (h_version == V6) {
 
-	os_set_colour (lo (cwp->colour), hi (cwp->colour));
+	batch_set_colour (lo (cwp->colour), hi (cwp->colour));
 
 	if (os_font_data (cwp->font, &font_height, &font_width))
-	    os_set_font (cwp->font);
+	    set_font (cwp->font);
 
-	os_set_text_style (cwp->style);
+	set_text_style (cwp->style);
 
     } else refresh_text_style ();
 
@@ -586,16 +768,16 @@ void erase_window (zword win)
     zword x = wp[win].x_pos;
 
     if (h_version == V6 && win != cwin && h_interpreter_number != INTERP_AMIGA)
-	os_set_colour (lo (wp[win].colour), hi (wp[win].colour));
+	batch_set_colour (lo (wp[win].colour), hi (wp[win].colour));
 
-    os_erase_area (y,
+    batch_erase_area (y,
 		   x,
 		   y + wp[win].y_size - 1,
 		   x + wp[win].x_size - 1,
 		   win);
 
     if (h_version == V6 && win != cwin && h_interpreter_number != INTERP_AMIGA)
-	os_set_colour (lo (cwp->colour), hi (cwp->colour));
+	batch_set_colour (lo (cwp->colour), hi (cwp->colour));
 
     reset_cursor (win);
 
@@ -663,7 +845,7 @@ static void erase_screen (zword win)
 {
     int i;
 
-    os_erase_area (1, 1, h_screen_height, h_screen_width, -2);
+    batch_erase_area (1, 1, h_screen_height, h_screen_width, -2);
 
     if ((short) win == -1) {
 	split_window (0);
@@ -685,6 +867,8 @@ static void erase_screen (zword win)
  */
 void resize_screen (void)
 {
+    reset_widths ();
+
     /* V6 games are asked to redraw.  Other versions have no means for that
        so we do what we can. */
     if (h_version == V6)
@@ -731,14 +915,16 @@ void resize_screen (void)
  */
 void restart_screen (void)
 {
+    reset_widths ();
+
     /* Use default settings */
 
-    os_set_colour (h_default_foreground, h_default_background);
+    batch_set_colour (h_default_foreground, h_default_background);
 
     if (os_font_data (TEXT_FONT, &font_height, &font_width))
-	os_set_font (TEXT_FONT);
+	set_font (TEXT_FONT);
 
-    os_set_text_style (0);
+    set_text_style (0);
 
     cursor = TRUE;
 
@@ -777,6 +963,7 @@ void restart_screen (void)
     if (h_version <= V3)
 	wp[7].x_size = h_screen_width;
 
+    batch_flush ();
     os_restart_game (RESTART_WPROP_SET);
 
     /* Clear the screen, unsplit it and select window 0 */
@@ -844,7 +1031,7 @@ void screen_mssg_on (void)
 {
     if (cwin == 0) {		/* messages in window 0 only */
 
-	os_set_text_style (0);
+	set_text_style (0);
 
 	if (cwp->x_cursor != cwp->left + 1)
 	    screen_new_line ();
@@ -924,6 +1111,7 @@ void z_draw_picture (void)
     int i;
 
     flush_buffer ();
+    batch_flush ();
 
     if (y == 0)			/* use cursor line if y-coordinate is 0 */
 	y = cwp->y_cursor;
@@ -999,7 +1187,7 @@ void z_erase_line (void)
     x = cwp->x_pos + cwp->x_cursor - 1;
 
     os_font_data(0, &font_height, &font_width);
-    os_erase_area (y, x, y + font_height - 1, x + pixels - 1, -1);
+    batch_erase_area (y, x, y + font_height - 1, x + pixels - 1, -1);
 
 }/* z_erase_line */
 
@@ -1031,7 +1219,7 @@ void z_erase_picture (void)
     y += cwp->y_pos - 1;
     x += cwp->x_pos - 1;
 
-    os_erase_area (y, x, y + height - 1, x + width - 1, -1);
+    batch_erase_area (y, x, y + height - 1, x + width - 1, -1);
 
 }/* z_erase_picture */
 
@@ -1290,19 +1478,19 @@ void z_scroll_window (void)
     /* Use the correct set of colours when scrolling the window */
 
     if (win != cwin && h_interpreter_number != INTERP_AMIGA)
-	os_set_colour (lo (wp[win].colour), hi (wp[win].colour));
+	batch_set_colour (lo (wp[win].colour), hi (wp[win].colour));
 
     y = wp[win].y_pos;
     x = wp[win].x_pos;
 
-    os_scroll_area (y,
+    batch_scroll_area (y,
 		    x,
 		    y + wp[win].y_size - 1,
 		    x + wp[win].x_size - 1,
 		    (short) zargs[1]);
 
     if (win != cwin && h_interpreter_number != INTERP_AMIGA)
-	os_set_colour (lo (cwp->colour), hi (cwp->colour));
+	batch_set_colour (lo (cwp->colour), hi (cwp->colour));
 
 }/* z_scroll_window */
 
@@ -1324,6 +1512,9 @@ void z_set_colour (void)
 
     flush_buffer ();
 
+    if ((short) fg == -1 || (short) bg == -1)
+	batch_flush ();		/* the screen must be up to date */
+
     if ((short) fg == -1)	/* colour -1 is the colour at the cursor */
 	fg = os_peek_colour ();
     if ((short) bg == -1)
@@ -1366,7 +1557,7 @@ void z_set_colour (void)
     wp[win].colour = (bg << 8) | fg;
 
     if (win == cwin || h_version != V6)
-	os_set_colour (fg, bg);
+	batch_set_colour (fg, bg);
 
 }/* z_set_colour */
 
@@ -1396,7 +1587,7 @@ void z_set_font (void)
 		print_char (ZC_NEW_FONT);
 		print_char (font);
 
-	    } else os_set_font (font);
+	    } else set_font (font);
 
 	} else store (0);
 
@@ -1549,7 +1740,7 @@ static void pad_status_line (int column)
 
     flush_buffer ();
 
-    spaces = units_left () / os_char_width (' ') - column;
+    spaces = units_left () / char_width (' ', text_font, text_style) - column;
 
     /* while (spaces--) */
     /* Justin Wesley's fix for narrow displays (Agenda PDA) */
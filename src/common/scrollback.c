@@ -0,0 +1,294 @@
+/* scrollback.c - Scrollback history of the lower window
+ *
+ * This file is part of Frotz.
+ *
+ * Frotz is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Frotz is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The screen module copies everything that is shown in the lower window
+ * here, one screen line at a time. The lines are kept in a ring of
+ * SCROLLBACK_SIZE slots; once the ring is full, each new line takes the
+ * slot of the oldest one. Every slot holds at most SCROLLBACK_LINE
+ * characters and its storage is reused, so memory use stays bounded
+ * however long the game runs.
+ *
+ * The text of a line may contain ZC_NEW_STYLE and ZC_NEW_FONT codes,
+ * each followed by its argument, just like the strings passed to
+ * os_display_string. A line starts by restating the style and font in
+ * effect if they are not the defaults, so it can be shown on its own.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "frotz.h"
+
+#ifndef SCROLLBACK_LINE
+#define SCROLLBACK_LINE 1024
+#endif
+
+typedef struct {
+    zchar *text;
+    int length;
+    int space;
+} line_t;
+
+static line_t *lines = NULL;
+static int first = 0;
+static int count = 0;
+static long started = 0;
+
+static int style = 0;
+static int font = TEXT_FONT;
+
+/*
+ * current_line
+ *
+ * Return the slot of the newest line.
+ *
+ */
+static line_t *current_line (void)
+{
+    return lines + (first + count - 1) % SCROLLBACK_SIZE;
+
+}/* current_line */
+
+
+/*
+ * append
+ *
+ * Add characters to the newest line, dropping whatever does not fit.
+ *
+ */
+static void append (const zchar *s, int n)
+{
+    line_t *line = current_line ();
+
+    if (line->length + n > SCROLLBACK_LINE)
+	n = SCROLLBACK_LINE - line->length;
+    if (n <= 0)
+	return;
+
+    if (line->length + n > line->space) {
+
+	int space = line->space ? line->space : 64;
+	zchar *p;
+
+	while (space < line->length + n)
+	    space *= 2;
+	if (space > SCROLLBACK_LINE)
+	    space = SCROLLBACK_LINE;
+
+	if ((p = realloc (line->text, space * sizeof (zchar))) == NULL)
+	    return;
+
+	line->text = p;
+	line->space = space;
+
+    }
+
+    memcpy (line->text + line->length, s, n * sizeof (zchar));
+    line->length += n;
+
+}/* append */
+
+
+/*
+ * scrollback_attribute
+ *
+ * Note a change of text style or font.
+ *
+ */
+void scrollback_attribute (zchar code, int value)
+{
+    zchar s[2];
+
+    if (lines == NULL)
+	return;
+
+    if (code == ZC_NEW_STYLE) {
+	if (value == style)
+	    return;
+	style = value;
+    } else {
+	if (value == font)
+	    return;
+	font = value;
+    }
+
+    s[0] = code;
+    s[1] = value;
+
+    /* Never leave half of a pair at the end of a full line */
+
+    if (current_line ()->length + 2 <= SCROLLBACK_LINE)
+	append (s, 2);
+
+}/* scrollback_attribute */
+
+
+/*
+ * scrollback_char
+ *
+ * Add a character to the current line.
+ *
+ */
+void scrollback_char (zchar c)
+{
+    if (lines != NULL)
+	append (&c, 1);
+
+}/* scrollback_char */
+
+
+/*
+ * scrollback_string
+ *
+ * Add a string to the current line. Style and font changes embedded in
+ * the string are tracked as well.
+ *
+ */
+void scrollback_string (const zchar *s)
+{
+    const zchar *run;
+
+    if (lines == NULL)
+	return;
+
+    while (*s != 0) {
+
+	if (*s == ZC_NEW_STYLE || *s == ZC_NEW_FONT) {
+
+	    scrollback_attribute (s[0], s[1]);
+	    s += 2;
+	    continue;
+
+	}
+
+	for (run = s; *s != 0 && *s != ZC_NEW_STYLE && *s != ZC_NEW_FONT; s++)
+	    ;
+
+	append (run, s - run);
+
+    }
+
+}/* scrollback_string */
+
+
+/*
+ * scrollback_new_line
+ *
+ * Start a new line, taking the slot of the oldest line when the ring
+ * is full.
+ *
+ */
+void scrollback_new_line (void)
+{
+    zchar s[4];
+    int n = 0;
+
+    if (lines == NULL)
+	return;
+
+    if (count < SCROLLBACK_SIZE)
+	count++;
+    else
+	first = (first + 1) % SCROLLBACK_SIZE;
+
+    started++;
+
+    current_line ()->length = 0;
+
+    if (style != 0)
+	{ s[n++] = ZC_NEW_STYLE; s[n++] = style; }
+    if (font != TEXT_FONT)
+	{ s[n++] = ZC_NEW_FONT; s[n++] = font; }
+
+    append (s, n);
+
+}/* scrollback_new_line */
+
+
+/*
+ * scrollback_count
+ *
+ * Return the number of lines kept, including the current one.
+ *
+ */
+int scrollback_count (void)
+{
+    return count;
+
+}/* scrollback_count */
+
+
+/*
+ * scrollback_started
+ *
+ * Return the number of lines started so far, including the current one
+ * and those no longer kept. This lets an interface find out which lines
+ * it has not seen yet.
+ *
+ */
+long scrollback_started (void)
+{
+    return started;
+
+}/* scrollback_started */
+
+
+/*
+ * scrollback_line
+ *
+ * Return line n, counting from the oldest line kept, and store its
+ * length. The text is not zero terminated and stays valid until the
+ * next line is started.
+ *
+ */
+const zchar *scrollback_line (int n, int *length)
+{
+    line_t *line;
+
+    if (n < 0 || n >= count)
+	{ *length = 0; return NULL; }
+
+    line = lines + (first + n) % SCROLLBACK_SIZE;
+
+    *length = line->length;
+    return line->text;
+
+}/* scrollback_line */
+
+
+/*
+ * init_scrollback
+ *
+ * Allocate the ring and start with an empty line.
+ *
+ */
+void init_scrollback (void)
+{
+    if (lines == NULL && (lines = calloc (SCROLLBACK_SIZE, sizeof (line_t))) == NULL)
+	os_fatal ("Out of memory");
+
+    first = 0;
+    count = 1;
+    started = 1;
+    lines[0].length = 0;
+
+    style = 0;
+    font = TEXT_FONT;
+
+}/* init_scrollback */
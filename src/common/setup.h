@@ -17,8 +17,20 @@ typedef struct frotz_setup_struct {
 	int undo_slots;			/* done */
 	int expand_abbreviations;	/* done */
 	int script_cols;		/* done */
+	int script_flush;		/* KB of transcript to buffer, 0 = a turn */
+	int script_sync;		/* fsync the transcript after writing */
 	int sound;			/* done */
 	int err_report_mode;		/* done */
+	long turn_instructions;		/* instruction budget per turn, 0 = none */
+	long turn_time;			/* CPU ms budget per turn, 0 = none */
+	long max_instructions;		/* limits per session, 0 = none */
+	long max_cpu_time;		/* CPU ms */
+	long max_turn_wall_time;	/* wall ms in one turn */
+	long max_output;		/* characters */
+	long max_undo_memory;		/* bytes */
+	long max_save_size;		/* bytes */
+	long trace_size;		/* instructions kept in the trace, 0 = off */
+	int code_map;			/* check the code and map its routines */
 
 	char *story_file;
         char *story_name;
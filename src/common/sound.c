@@ -198,6 +198,11 @@ void z_sound_effect (void)
 
 	locked = FALSE;
 
-    } else os_beep (number);
+    } else {
+
+	batch_flush ();
+	os_beep (number);
+
+    }
 
 }/* z_sound_effect */
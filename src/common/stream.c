@@ -35,13 +35,14 @@ extern void script_close (void);
 
 extern void memory_word (const zchar *);
 extern void memory_new_line (void);
-extern void record_write_key (zchar);
-extern void record_write_input (const zchar *, zchar);
+extern void record_write_key (zchar, zword);
+extern void record_write_input (const zchar *, zchar, zword);
 extern void script_char (zchar);
 extern void script_word (const zchar *);
 extern void script_new_line (void);
 extern void script_write_input (const zchar *, zchar);
 extern void script_erase_input (const zchar *);
+extern void script_end_turn (void);
 extern void script_mssg_on (void);
 extern void script_mssg_off (void);
 extern void screen_char (zchar);
@@ -136,6 +137,27 @@ void z_output_stream (void)
 }/* z_output_stream */
 
 
+/* Output is counted once, whether it goes to the screen, the
+   transcript or both, and not at all while both are turned off */
+
+#define SHOWN (ostream_screen || (ostream_script && enable_scripting))
+
+/*
+ * count_output
+ *
+ * Count characters sent to the screen or transcript.
+ *
+ */
+static void count_output (long n)
+{
+    usage.output += n;
+
+    if (f_setup.max_output > 0 && usage.output > f_setup.max_output)
+	usage_check ();
+
+}/* count_output */
+
+
 /*
  * stream_char
  *
@@ -144,6 +166,9 @@ void z_output_stream (void)
  */
 void stream_char (zchar c)
 {
+    if (SHOWN)
+	count_output (1);
+
     if (ostream_screen)
 	screen_char (c);
     if (ostream_script && enable_scripting)
@@ -166,6 +191,19 @@ void stream_word (const zchar *s)
 
     else {
 
+	if (SHOWN) {
+
+	    const zchar *p;
+	    long n = 0;
+
+	    for (p = s; *p != 0; p++)
+		if (*p == ZC_NEW_STYLE || *p == ZC_NEW_FONT)
+		    p++;
+		else
+		    n++;
+	    count_output (n);
+	}
+
 	if (ostream_screen)
 	    screen_word (s);
 	if (ostream_script && enable_scripting)
@@ -189,6 +227,9 @@ void stream_new_line (void)
 
     else {
 
+	if (SHOWN)
+	    count_output (1);
+
 	if (ostream_screen)
 	    screen_new_line ();
 	if (ostream_script && enable_scripting)
@@ -229,10 +270,15 @@ zchar stream_read_key ( zword timeout, zword routine, bool hot_keys )
 
     flush_buffer ();
 
+    if (ostream_script)
+	script_end_turn ();
+
     /* Read key from current input stream */
 
 continue_input:
 
+    end_turn ();
+
     do {
 
 	if (istream_replay)
@@ -242,6 +288,8 @@ continue_input:
 
     } while (key == ZC_BAD);
 
+    start_turn ();
+
     /* Verify mouse clicks */
 
     if (key == ZC_SINGLE_CLICK || key == ZC_DOUBLE_CLICK)
@@ -251,7 +299,7 @@ continue_input:
     /* Copy key to the command file */
 
     if (ostream_record && !istream_replay)
-	record_write_key (key);
+	record_write_key (key, timeout);
 
     /* Handle timeouts */
 
@@ -301,10 +349,15 @@ zchar stream_read_input ( int max, zchar *buf,
     if (istream_replay)
 	screen_erase_input (buf);
 
+    if (ostream_script)
+	script_end_turn ();
+
     /* Read input line from current input stream */
 
 continue_input:
 
+    end_turn ();
+
     do {
 
 	if (istream_replay)
@@ -314,6 +367,8 @@ continue_input:
 
     } while (key == ZC_BAD);
 
+    start_turn ();
+
     /* Verify mouse clicks */
 
     if (key == ZC_SINGLE_CLICK || key == ZC_DOUBLE_CLICK)
@@ -323,7 +378,7 @@ continue_input:
     /* Copy input line to the command file */
 
     if (ostream_record && !istream_replay)
-	record_write_input (buf, key);
+	record_write_input (buf, key, timeout);
 
     /* Handle timeouts */
 
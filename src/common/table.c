@@ -18,8 +18,11 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
  */
 
+#include <string.h>
 #include "frotz.h"
 
+extern void memory_written (zword, zword);
+
 
 /*
  * z_copy_table, copy a table or fill it with zeroes.
@@ -37,8 +40,38 @@ void z_copy_table (void)
     zword addr;
     zword size = zargs[2];
     zbyte value;
+    long count;
+    long dest;
     int i;
 
+    /* Fast path: the whole destination lies within dynamic memory and
+       neither range wraps around the end of the address space, so the
+       range check and the side effects of storeb happen only once */
+
+    if (zargs[1] == 0) {
+	count = size;
+	dest = zargs[0];
+    } else {
+	count = ((short) size < 0) ? - (long) (short) size : (long) size;
+	dest = zargs[1];
+    }
+
+    if (dest + count <= h_dynamic_size && zargs[0] + count <= 0x10000L) {
+
+	if (zargs[1] == 0)
+	    memset (zmp + zargs[0], 0, count);
+	else if ((short) size < 0 && zargs[1] > zargs[0] && zargs[1] < zargs[0] + count)
+	    for (i = 0; i < count; i++)		/* overlapping forward copy */
+		zmp[zargs[1] + i] = zmp[zargs[0] + i];
+	else
+	    memmove (zmp + zargs[1], zmp + zargs[0], count);
+
+	memory_written ((zword) dest, (zword) count);
+
+	return;
+
+    }
+
     if (zargs[1] == 0)      				/* zero table */
 
 	for (i = 0; i < size; i++)
@@ -116,6 +149,8 @@ void z_loadw (void)
 void z_scan_table (void)
 {
     zword addr = zargs[1];
+    zbyte *p;
+    zbyte *end;
     int i;
 
     /* Supply default arguments */
@@ -123,6 +158,37 @@ void z_scan_table (void)
     if (zargc < 4)
 	zargs[3] = 0x82;
 
+    /* Scan plain byte and word arrays directly unless they wrap around */
+
+    if ((zargs[3] == 0x01 || zargs[3] == 0x82)
+	&& (long) addr + (long) zargs[2] * (zargs[3] & 0x7f) <= 0x10000L) {
+
+	p = zmp + addr;
+
+	if (zargs[3] == 0x01) {		/* byte array */
+
+	    p = (zargs[0] <= 0xff) ? memchr (p, zargs[0], zargs[2]) : NULL;
+
+	} else {			/* word array */
+
+	    for (end = p + 2 * zargs[2]; p < end; p += 2)
+		if (load_word (p) == zargs[0])
+		    break;
+
+	    if (p >= end)
+		p = NULL;
+
+	}
+
+	addr = (p != NULL) ? (zword) (p - zmp) : 0;
+
+	store (addr);
+	branch (addr);
+
+	return;
+
+    }
+
     /* Scan byte or word array */
 
     for (i = 0; i < zargs[2]; i++) {
@@ -0,0 +1,334 @@
+/* trace.c - Instruction trace kept in a ring buffer
+ *
+ * This file is part of Frotz.
+ *
+ * Frotz is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Frotz is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * When f_setup.trace_size is set, process.c runs a separate interpreter
+ * loop that records every instruction it executes in a ring buffer
+ * holding the last trace_size of them; without a trace, the usual loop
+ * runs untouched. Nothing is formatted while the game runs: an entry is
+ * the PC, the opcode and the raw operands, plus the value stored and
+ * the branch condition if the instruction had them. The operands are
+ * copied when the next instruction starts, which also catches the
+ * defaults some opcodes fill in.
+ *
+ * The value stored and the branch condition are read back from the
+ * variable and the PC once the instruction has run. Where it left the
+ * frame it started in, as calls and returns do, the value stored is not
+ * known and neither is the condition, unless the branch was one that
+ * returns.
+ *
+ * The buffer is written out as text, oldest instruction first, when a
+ * runtime error is reported or when an interface asks for it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "frotz.h"
+
+typedef struct {
+    long pc;
+    zword args[8];
+    zword stored;			/* value stored, if any */
+    zbyte branched;			/* condition branched on, if any */
+    zbyte opcode;
+    zbyte ext;				/* extended opcode after 0xbe */
+    zbyte argc;
+    zbyte flags;
+} trace_entry_t;
+
+#define TRACE_STORED 1
+#define TRACE_BRANCHED 2
+
+bool tracing = FALSE;
+
+static trace_entry_t *ring = NULL;
+static trace_entry_t *current = NULL;
+static long ring_size = 0;
+static long next = 0;
+static long recorded = 0;
+
+
+/*
+ * init_trace
+ *
+ * Allocate the ring buffer and start tracing if the user asked for it.
+ *
+ */
+void init_trace (void)
+{
+    if (f_setup.trace_size <= 0)
+	return;
+
+    ring_size = f_setup.trace_size;
+
+    if ((ring = malloc (ring_size * sizeof (trace_entry_t))) == NULL)
+	os_fatal ("Out of memory");
+
+    tracing = TRUE;
+
+}/* init_trace */
+
+
+/*
+ * complete
+ *
+ * Copy the operands of the instruction being traced into its entry.
+ *
+ */
+static void complete (void)
+{
+    current->argc = zargc;
+    memcpy (current->args, zargs, zargc * sizeof (zword));
+
+}/* complete */
+
+
+/*
+ * trace_begin
+ *
+ * Start a new entry for the instruction at the PC.
+ *
+ */
+void trace_begin (void)
+{
+    long pc;
+
+    if (current != NULL)
+	complete ();
+
+    current = ring + next;
+
+    if (++next == ring_size)
+	next = 0;
+    recorded++;
+
+    GET_PC (pc)
+
+    current->pc = pc;
+    current->opcode = pcp[0];
+    current->ext = (pcp[0] == 0xbe) ? pcp[1] : 0;
+    current->argc = 0;
+    current->flags = 0;
+
+}/* trace_begin */
+
+
+/*
+ * trace_result
+ *
+ * Record the value stored by the current instruction and the condition
+ * it branched on. The store variable and the branch follow the operands
+ * at addr, or the operand types of an extended opcode. Frame is the
+ * frame pointer the instruction started with.
+ *
+ */
+void trace_result (long addr, zword *frame)
+{
+    bool same_frame = (fp == frame);
+    zbyte info;
+    long pc;
+
+    if (current == NULL)
+	return;
+
+    if (current->opcode == 0xbe) {
+
+	zbyte types = zmp[addr + 1];
+	int shift;
+
+	addr += 2;
+
+	for (shift = 6; shift >= 0 && ((types >> shift) & 3) != 3; shift -= 2)
+	    addr += (((types >> shift) & 3) == 0) ? 2 : 1;
+
+    }
+
+    info = opcode_info (current->opcode, current->ext);
+
+    GET_PC (pc)
+
+    if (info & OPCODE_STORE) {
+
+	zbyte variable = zmp[addr++];
+
+	/* A store without a branch is the last thing the instruction
+	   does; with a branch, the branch below decides */
+
+	if (same_frame && ((info & OPCODE_BRANCH) || pc == addr)) {
+
+	    if (variable == 0)
+		current->stored = *sp;
+	    else if (variable < 16)
+		current->stored = *(fp - variable);
+	    else
+		LOW_WORD (h_globals + 2 * (variable - 16), current->stored)
+
+	    current->flags |= TRACE_STORED;
+	}
+
+    }
+
+    if (info & OPCODE_BRANCH) {
+
+	zbyte specifier = zmp[addr++];
+	long offset;
+	int taken = -1;
+
+	if (specifier & 0x40)
+	    offset = specifier & 0x3f;
+	else {
+	    offset = ((specifier & 0x3f) << 8) | zmp[addr++];
+	    if (offset & 0x2000)
+		offset -= 0x4000;
+	}
+
+	/* addr is now the next instruction; a branch to it tells
+	   nothing about the condition */
+
+	if (offset == 2)
+	    taken = -1;
+	else if (same_frame && pc == addr)
+	    taken = 0;
+	else if (same_frame && (offset > 1 || offset < 0) && pc == addr + offset - 2)
+	    taken = 1;
+	else if (!same_frame && (offset == 0 || offset == 1))
+	    taken = 1;
+
+	if (taken >= 0) {
+	    current->branched = (taken == ((specifier & 0x80) != 0));
+	    current->flags |= TRACE_BRANCHED;
+	}
+
+    }
+
+}/* trace_result */
+
+
+/*
+ * trace_mark
+ *
+ * Remember the current instruction before the interpreter loop is
+ * entered again from within it. Pass the result to trace_return when
+ * the loop ends.
+ *
+ */
+long trace_mark (void)
+{
+    return recorded;
+
+}/* trace_mark */
+
+
+/*
+ * trace_return
+ *
+ * Finish the last instruction of a nested interpreter loop and go back
+ * to the instruction that started it, if it is still in the buffer.
+ *
+ */
+void trace_return (long mark)
+{
+    if (current != NULL)
+	complete ();
+
+    if (mark > 0 && recorded - mark < ring_size)
+	current = ring + (mark - 1) % ring_size;
+    else
+	current = NULL;
+
+}/* trace_return */
+
+
+/*
+ * trace_dump
+ *
+ * Write the trace to the named file, or to the story name with the
+ * trace extension if none is given. Return the number of instructions
+ * written or -1 if the file cannot be written.
+ *
+ */
+long trace_dump (const char *name)
+{
+    char *default_name = NULL;
+    FILE *fp;
+    long count;
+    long i;
+    int j;
+
+    if (ring == NULL)
+	return 0;
+
+    if (name == NULL) {
+	default_name = malloc (strlen (f_setup.story_name) + strlen (EXT_TRACE) + 1);
+	if (default_name == NULL)
+	    return -1;
+	strcpy (default_name, f_setup.story_name);
+	strcat (default_name, EXT_TRACE);
+	name = default_name;
+    }
+
+    fp = fopen (name, "w");
+    free (default_name);
+
+    if (fp == NULL)
+	return -1;
+
+    if (current != NULL)
+	complete ();
+
+    count = (recorded < ring_size) ? recorded : ring_size;
+
+    fprintf (fp, "Last %ld of %ld instructions, oldest first\n",
+	count, recorded);
+
+    for (i = 0; i < count; i++) {
+
+	trace_entry_t *e = ring + (next - count + i + ring_size) % ring_size;
+	char line[80];
+	int n;
+
+	n = sprintf (line, "%05lx  %02x", e->pc, e->opcode);
+
+	if (e->opcode == 0xbe)
+	    n += sprintf (line + n, ":%02x", e->ext);
+	else
+	    n += sprintf (line + n, "   ");
+
+	for (j = 0; j < e->argc; j++)
+	    n += sprintf (line + n, " %04x", e->args[j]);
+
+	if (e->flags & TRACE_STORED)
+	    n += sprintf (line + n, " -> %04x", e->stored);
+	if (e->flags & TRACE_BRANCHED)
+	    n += sprintf (line + n, " ?%s", e->branched ? "true" : "false");
+
+	while (n > 0 && line[n - 1] == ' ')
+	    n--;
+	line[n] = 0;
+
+	fprintf (fp, "%s\n", line);
+    }
+
+    if (fclose (fp) != 0)
+	return -1;
+
+    return count;
+
+}/* trace_dump */
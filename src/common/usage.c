@@ -0,0 +1,160 @@
+/* usage.c - Resource accounting and limits
+ *
+ * This file is part of Frotz.
+ *
+ * Frotz is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Frotz is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+/*
+ * The modules that use a resource add to the counters in "usage" as
+ * they go: fastmem.c for undo memory and save files, stream.c for
+ * output. Instructions, processor time and wall time are kept by
+ * process.c turn by turn and added here at the end of each turn. A turn
+ * runs from the moment input arrives until the game asks for more. An
+ * interface reads the whole picture with get_usage.
+ *
+ * The limits are in f_setup, zero meaning none. Undo memory and save
+ * files are kept within theirs by the modules concerned; going over any
+ * of the others stops the interpreter.
+ */
+
+#include <string.h>
+#include <time.h>
+#include "frotz.h"
+
+usage_t usage;
+
+static clock_t cpu_started = 0;
+static time_t wall_started = 0;
+
+
+/*
+ * cpu_ms
+ *
+ * Return the processor time used since the session started, in
+ * milliseconds.
+ *
+ */
+static long cpu_ms (void)
+{
+    return (long) ((clock () - cpu_started) * 1000.0 / CLOCKS_PER_SEC);
+
+}/* cpu_ms */
+
+
+/*
+ * wall_ms
+ *
+ * Return a wall clock in milliseconds. Where the system has one, the
+ * clock is not thrown off by changes to the system time.
+ *
+ */
+long wall_ms (void)
+{
+#ifdef CLOCK_MONOTONIC
+    struct timespec now;
+
+    if (clock_gettime (CLOCK_MONOTONIC, &now) == 0)
+	return (long) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+
+    return (long) time (NULL) * 1000;
+
+}/* wall_ms */
+
+
+/*
+ * init_usage
+ *
+ * Start counting.
+ *
+ */
+void init_usage (void)
+{
+    memset (&usage, 0, sizeof usage);
+
+    cpu_started = clock ();
+    wall_started = time (NULL);
+
+}/* init_usage */
+
+
+/*
+ * usage_end_turn
+ *
+ * Add a finished turn to the totals.
+ *
+ */
+void usage_end_turn (long instructions, long ms, long wall)
+{
+    usage.instructions += instructions;
+    usage.turns++;
+
+    if (instructions > usage.peak_turn_instructions)
+	usage.peak_turn_instructions = instructions;
+    if (ms > usage.peak_turn_time)
+	usage.peak_turn_time = ms;
+    if (wall > usage.peak_turn_wall_time)
+	usage.peak_turn_wall_time = wall;
+
+}/* usage_end_turn */
+
+
+/*
+ * usage_check
+ *
+ * Stop the interpreter if it has gone over its instruction, processor
+ * time, turn wall time or output limit.
+ *
+ */
+void usage_check (void)
+{
+    long wall;
+
+    if (f_setup.max_instructions > 0
+	&& usage.instructions + turn_usage (NULL, NULL) >= f_setup.max_instructions)
+	os_fatal ("Instruction limit reached");
+
+    if (f_setup.max_turn_wall_time > 0) {
+	turn_usage (NULL, &wall);
+	if (wall >= f_setup.max_turn_wall_time)
+	    os_fatal ("Turn wall time limit reached");
+    }
+
+    if (f_setup.max_cpu_time > 0 && cpu_ms () >= f_setup.max_cpu_time)
+	os_fatal ("Processor time limit reached");
+
+    if (f_setup.max_output > 0 && usage.output > f_setup.max_output)
+	os_fatal ("Output limit reached");
+
+}/* usage_check */
+
+
+/*
+ * get_usage
+ *
+ * Store the counters, including the turn in progress.
+ *
+ */
+void get_usage (usage_t *u)
+{
+    *u = usage;
+
+    u->turn_instructions = turn_usage (&u->turn_time, &u->turn_wall_time);
+    u->instructions += u->turn_instructions;
+    u->cpu_time = cpu_ms ();
+    u->wall_time = (long) difftime (time (NULL), wall_started);
+
+}/* get_usage */
@@ -0,0 +1,5 @@
+#include "frotz.h"
+const char frotz_version[] = "2.44";
+const char frotz_v_major[] = "2";
+const char frotz_v_minor[] = "44";
+const char frotz_v_build[] = "20261018.222115";
@@ -0,0 +1,7 @@
+#define CONFIG_DIR "/etc"
+#define SOUND "none"
+#define SAMPLERATE 44100
+#define BUFFSIZE 4096
+#define DEFAULT_CONVERTER SRC_SINC_MEDIUM_QUALITY
+#define NO_SOUND
+#define COLOR_SUPPORT
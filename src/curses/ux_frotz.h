@@ -79,7 +79,8 @@ extern char *gamepath;	/* use to find sound files */
 extern f_setup_t f_setup;
 extern u_setup_t u_setup;
 
-extern volatile sig_atomic_t terminal_resized;
+extern int signal_pipe[2];			/* ux_init */
+extern volatile sig_atomic_t waiting_for_input;	/* ux_input */
 
 /*** Functions specific to the Unix port of Frotz ***/
 
@@ -89,6 +90,7 @@ bool unix_init_pictures(void);		/* ux_pic.c */
 // void unix_do_scrollback(void);		/* ux_screen.c */
 void unix_resize_display(void);		/* ux_screen.c */
 void unix_suspend_program(void);        /* ux_screen.c */
+void unix_refresh(void);		/* ux_screen.c */
 void unix_get_terminal_size(void);      /* ux_init.c */
 
 
@@ -31,6 +31,8 @@
 #include <ctype.h>
 #include <signal.h>
 #include <libgen.h>
+#include <errno.h>
+#include <fcntl.h>
 
 #ifdef USE_NCURSES_H
 #include <ncurses.h>
@@ -45,7 +47,7 @@
 #include "ux_frotz.h"
 #include "ux_blorb.h"
 
-volatile sig_atomic_t terminal_resized = 0;
+int signal_pipe[2] = { -1, -1 };
 
 static void sigwinch_handler(int);
 #define INFORMATION "\
@@ -211,6 +213,15 @@ void os_process_arguments (int argc, char *argv[])
  */
 
 
+    /* The signal handlers wake up unix_read_char through this pipe. */
+    if (pipe(signal_pipe) == 0) {
+	fcntl(signal_pipe[0], F_SETFL, O_NONBLOCK);
+	fcntl(signal_pipe[1], F_SETFL, O_NONBLOCK);
+	fcntl(signal_pipe[0], F_SETFD, FD_CLOEXEC);
+	fcntl(signal_pipe[1], F_SETFD, FD_CLOEXEC);
+    } else
+	signal_pipe[0] = signal_pipe[1] = -1;
+
 //    if (signal(SIGWINCH, SIG_IGN) != SIG_IGN)
 	signal(SIGWINCH, sigwinch_handler);
 
@@ -533,6 +544,14 @@ void os_init_screen (void)
     }
     os_set_colour(h_default_foreground, h_default_background);
     os_erase_area(1, 1, h_screen_rows, h_screen_cols, 0);
+
+    /* Strings are as wide as the sum of their characters */
+    text_width_mode = WIDTH_CHARS;
+
+    /* Hold back screen output until the next input wait, then draw it
+     * one run of text at a time.
+     */
+    batch_set_sink(batch_replay);
 }/* os_init_screen */
 
 
@@ -997,17 +1016,35 @@ static int geterrmode(char *value)
 } /* geterrmode() */
 
 
+/*
+ * signal_event
+ *
+ * Tell unix_read_char about a signal.  Only write(2) is used, so this
+ * is safe in a signal handler.
+ *
+ */
+static void signal_event(char event)
+{
+    int saved_errno = errno;
+
+    if (write(signal_pipe[1], &event, 1) < 0) {
+	/* The pipe is full, so unix_read_char will wake up anyway. */
+    }
+    errno = saved_errno;
+}
+
+
 /*
  * sigwinch_handler
  *
  * Called whenever Frotz recieves a SIGWINCH signal to make curses
- * cleanly resize the window.  To be safe, just set a flag here.
- * It is checked and cleared in unix_read_char.
+ * cleanly resize the window.  To be safe, just note the event here.
+ * It is acted upon in unix_read_char.
  *
  */
 static void sigwinch_handler(int UNUSED(sig))
 {
-    terminal_resized = 1;
+    signal_event('w');
     signal(SIGWINCH, sigwinch_handler);
 }
 
@@ -1015,13 +1052,18 @@ static void sigwinch_handler(int UNUSED(sig))
 /*
  * sigint_handler
  * Sometimes the screen will be left in a weird state if the following
- * is not done.
+ * is not done.  While waiting for input, leave it to unix_read_char.
  *
  */
 static void sigint_handler(int UNUSED(dummy))
 {
     signal(SIGINT, sigint_handler);
 
+    if (waiting_for_input && signal_pipe[1] != -1) {
+	signal_event('i');
+	return;
+    }
+
     os_stop_sample(0);
     scrollok(stdscr, TRUE); scroll(stdscr);
     refresh(); endwin();
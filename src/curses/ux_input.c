@@ -28,8 +28,9 @@
 #include <limits.h>
 
 #include <errno.h>
-#include <sys/time.h>
-#include <sys/select.h>
+#include <time.h>
+#include <poll.h>
+#include <unistd.h>
 
 #ifdef USE_NCURSES_H
 #include <ncurses.h>
@@ -42,7 +43,9 @@
 static int start_of_prev_word(int, const zchar*);
 static int end_of_next_word(int, const zchar*, int);
 
-static struct timeval global_timeout;
+static long global_deadline = -1;
+
+volatile sig_atomic_t waiting_for_input = 0;
 
 /* Some special characters. */
 #define MOD_CTRL 0x40
@@ -65,80 +68,78 @@ extern void read_string (int, zchar *);
 extern int completion (const zchar *, zchar *);
 
 /*
- * unix_set_global_timeout
+ * unix_now
  *
- * This sets up a time structure to determine when unix_read_char should
- * return zero (representing input timeout).  When current system time
- * equals global_timeout, boom.
+ * Return the time in milliseconds on a clock that is not affected by
+ * changes to the system time.
  *
  */
-static void unix_set_global_timeout(int timeout)
+static long unix_now(void)
 {
-    if (!timeout) global_timeout.tv_sec = 0;
-    else {
-        gettimeofday(&global_timeout, NULL);
-        global_timeout.tv_sec += (timeout/10);
-        global_timeout.tv_usec += ((timeout%10)*100000);
-        if (global_timeout.tv_usec > 999999) {
-          global_timeout.tv_sec++;
-          global_timeout.tv_usec -= 1000000;
-        }
-    }
-    return;
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
 }
 
 
 /*
- * Time left until input timeout.  Return whether an input timeout
- * is in effect and it it is, set diff to the time left until the
- * timeout elapses or zero if it has already elapsed.  If false is returned,
- * diff is not modified, otherwise it is set to a non-negative value.
+ * unix_set_global_timeout
+ *
+ * This sets the time at which unix_read_char should return zero
+ * (representing input timeout).  A timeout of zero means no timeout.
+ *
  */
-static bool timeout_left(struct timeval *diff)
+static void unix_set_global_timeout(int timeout)
 {
-    struct timeval now;
-
-    if (global_timeout.tv_sec == 0)
-        return false;
-    gettimeofday( &now, NULL);
-    diff->tv_usec = global_timeout.tv_usec - now.tv_usec;
-    if (diff->tv_usec < 0) {
-	/* Carry */
-	now.tv_sec++;
-	diff->tv_usec += 1000000;
-    }
-    diff->tv_sec = global_timeout.tv_sec - now.tv_sec;
-    if (diff->tv_sec < 0) {
-        diff->tv_sec = diff->tv_usec = 0;
-    }
-    return true;
+    global_deadline = timeout ? unix_now() + timeout * 100L : -1;
 }
 
 
-#if 0
 /*
  * Time left until input timeout.  Return the number of milliseconds left
  * until the input timeout elapses, zero if it has already elapsed, -1 if
- * no timeout is in effect.
+ * no timeout is in effect.  This is what poll(2) expects.
  */
-static int timeout_to_ms()
+static int timeout_left(void)
 {
-    struct timeval diff;
-    if (!timeout_left(&diff))
+    long left;
+
+    if (global_deadline < 0)
         return -1;
-    if (diff.tv_sec >= INT_MAX / 1000 - 1) /* Paranoia... */
-        return INT_MAX - 1000;
-    return diff.tv_sec * 1000 + diff.tv_usec / 1000;
+    left = global_deadline - unix_now();
+    return left > 0 ? (int) left : 0;
 }
-#endif
 
 
 void os_tick()
 {
-    while (terminal_resized) {
-        terminal_resized = 0;
-        unix_resize_display();
-    }
+    /* Nothing to do: signals are handled in unix_read_char. */
+}
+
+
+/*
+ * unix_signal_events
+ *
+ * Act on the signals that the handlers in ux_init.c have written to
+ * signal_pipe.
+ *
+ */
+static void unix_signal_events(void)
+{
+    char events[16];
+    bool resized = FALSE;
+    ssize_t i, n;
+
+    while ((n = read(signal_pipe[0], events, sizeof events)) > 0)
+	for (i = 0; i < n; i++) {
+	    if (events[i] == 'i')
+		os_quit();
+	    if (events[i] == 'w')
+		resized = TRUE;
+	}
+    if (resized)
+	unix_resize_display();
 }
 
 
@@ -156,28 +157,31 @@ void os_tick()
  */
 static int unix_read_char(int extkeys)
 {
-    int c, sel, fd = fileno(stdin);
-    fd_set rsel;
-    struct timeval tval, *t_left;
+    struct pollfd fds[2];
+    int c, n;
+
+    fds[0].fd = fileno(stdin);
+    fds[0].events = POLLIN;
+    fds[1].fd = signal_pipe[0];
+    fds[1].events = POLLIN;
 
     while(1) {
-        /* Wait with select so that we get interrupted on SIGWINCH. */
-        FD_ZERO(&rsel);
-        FD_SET(fd, &rsel);
-        os_tick();
-        refresh();
-        t_left = timeout_left(&tval) ? &tval : NULL;
-        sel = select(fd + 1, &rsel, NULL, NULL, t_left);
-        if (terminal_resized)
-            continue;
-        switch (sel) {
-        case -1:
+        /* Wait for a key, the input timeout, or a signal. */
+        unix_refresh();
+        waiting_for_input = 1;
+        n = poll(fds, 2, timeout_left());
+        waiting_for_input = 0;
+        if (n == -1) {
             if (errno != EINTR)
                 os_fatal(strerror(errno));
             continue;
-        case 0:
-            return ZC_TIME_OUT;
         }
+        if (fds[1].revents & POLLIN) {
+            unix_signal_events();
+            continue;
+        }
+        if (n == 0)
+            return ZC_TIME_OUT;
 
         timeout(0);
 	c = getch();
@@ -509,9 +513,6 @@ zchar os_read_line (int bufmax, zchar *buf, int timeout, int width,
         if (scrpos >= width)
             scrpos = width - 1;
 	move(y, x + scrpos);
-	/* Maybe there's a cleaner way to do this, but refresh() is */
-	/* still needed here to print spaces.  --DG */
-	refresh();
 	ch = unix_read_char(1);
 	getyx(stdscr, y, x2);
 	x2++;   /*XXX Eliminate compiler warning. */
@@ -694,7 +695,6 @@ zchar os_read_key (int timeout, int cursor)
 {
     zchar c;
 
-    refresh();
     if (!cursor) curs_set(0);
 
     unix_set_global_timeout(timeout);
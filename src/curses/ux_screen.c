@@ -52,6 +52,7 @@ static WINDOW *saved_screen = NULL;
  */
 void os_erase_area (int top, int left, int bottom, int right, int UNUSED(win))
 {
+    static const char blanks[] = "                                        ";
     int y, x, i, j;
 
     /* Catch the most common situation and do things the easy way */
@@ -75,8 +76,8 @@ void os_erase_area (int top, int left, int bottom, int right, int UNUSED(win))
 	top--; left--; bottom--; right--;
 	for (i = top; i <= bottom; i++) {
 	  move(i, left);
-	  for (j = left; j <= right; j++)
-	    addch(' ');
+	  for (j = left; j <= right; j += sizeof blanks - 1)
+	    addnstr(blanks, MIN(right - j + 1, (int) sizeof blanks - 1));
 	}
 	move(y, x);
 	os_set_text_style(saved_style);
@@ -108,28 +109,26 @@ void os_scroll_area (int top, int left, int bottom, int right, int units)
     scrl(units);
     scrollok(stdscr, FALSE);
   } else {
-    int row, col, x, y;
-    chtype ch;
+    int row, x, y, width = right - left + 1;
+    chtype *line;
 
+    /* Copy whole rows; attributes travel with the characters.  */
+    if ((line = malloc((width + 1) * sizeof(chtype))) == NULL)
+      os_fatal("Out of memory");
     getyx(stdscr, y, x);
-    /* Must turn off attributes during copying.  */
-    attrset(0);
     if (units > 0) {
-      for (row = top; row <= bottom - units; row++)
-	for (col = left; col <= right; col++) {
-	  ch = mvinch(row + units, col);
-	  mvaddch(row, col, ch);
-	}
+      for (row = top; row <= bottom - units; row++) {
+	mvinchnstr(row + units, left, line, width);
+	mvaddchnstr(row, left, line, width);
+      }
     } else if (units < 0) {
-      for (row = bottom; row >= top - units; row--)
-	for (col = left; col <= right; col++) {
-	  ch = mvinch(row + units, col);
-	  mvaddch(row, col, ch);
-	}
+      for (row = bottom; row >= top - units; row--) {
+	mvinchnstr(row + units, left, line, width);
+	mvaddchnstr(row, left, line, width);
+      }
     }
-    /* Restore attributes.  */
-    os_set_text_style(u_setup.current_text_style);
     move(y, x);
+    free(line);
   }
   if (units > 0)
     os_erase_area(bottom - units + 2, left + 1, bottom + 1, right + 1, 0);
@@ -138,6 +137,30 @@ void os_scroll_area (int top, int left, int bottom, int right, int units)
 }/* os_scroll_area */
 
 
+/*
+ * unix_refresh
+ *
+ * Bring the terminal up to date before waiting for input.  Output held
+ * back since the last wait is drawn first.  Curses keeps track of the
+ * changed part of every line; if no line has changed and the cursor has
+ * not moved, the terminal is left alone.
+ *
+ */
+void unix_refresh(void)
+{
+    static int shown_y = -1, shown_x = -1;
+    int y, x;
+
+    batch_flush();
+    getyx(stdscr, y, x);
+    if (is_wintouched(stdscr) || y != shown_y || x != shown_x) {
+	refresh();
+	shown_y = y;
+	shown_x = x;
+    }
+}/* unix_refresh */
+
+
 static void save_screen(void)
 {
     if ((saved_screen = newpad(h_screen_rows, h_screen_cols))
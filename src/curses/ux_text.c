@@ -191,60 +191,79 @@ void os_set_font (int UNUSED(new_font))
 
 
 /*
- * os_display_char
+ * unix_char_text
  *
- * Display a character of the current font using the current colours and
- * text style. The cursor moves to the next position. Printable codes are
- * all ASCII values from 32 to 126, ISO Latin-1 characters from 160 to
- * 255, ZC_GAP (gap between two sentences) and ZC_INDENT (paragraph
- * indentation). The screen should not be scrolled after printing to the
- * bottom right corner.
+ * Store the text shown for a character in s (at most three bytes) and
+ * return its length.
  *
  */
-void os_display_char (zchar c)
+static int unix_char_text (zchar c, char *s)
 {
     if (c >= ZC_LATIN1_MIN) {
         if (u_setup.plain_ascii) {
 
 	  char *ptr = latin1_to_ascii + 3 * (c - ZC_LATIN1_MIN);
-	  char c1 = *ptr++;
-	  char c2 = *ptr++;
-	  char c3 = *ptr++;
+	  int n = 1;
 
-	  addch(c1);
+	  s[0] = ptr[0];
+	  if (ptr[1] != ' ')
+	    s[n++] = ptr[1];
+	  if (ptr[2] != ' ')
+	    s[n++] = ptr[2];
+	  return n;
 
-	  if (c2 != ' ')
-	    addch(c2);
-	  if (c3 != ' ')
-	    addch(c3);
-
-	} else
-	  addch(c);
-	return;
+	}
+	s[0] = c;
+	return 1;
     }
     if (c >= ZC_ASCII_MIN && c <= ZC_ASCII_MAX) {
-        addch(c);
-	return;
+	s[0] = c;
+	return 1;
     }
     if (c == ZC_INDENT) {
-      addch(' '); addch(' '); addch(' ');
-      return;
+      s[0] = s[1] = s[2] = ' ';
+      return 3;
     }
     if (c == ZC_GAP) {
-      addch(' '); addch(' ');
-      return;
+      s[0] = s[1] = ' ';
+      return 2;
     }
+    return 0;
+}/* unix_char_text */
+
+
+/*
+ * os_display_char
+ *
+ * Display a character of the current font using the current colours and
+ * text style. The cursor moves to the next position. Printable codes are
+ * all ASCII values from 32 to 126, ISO Latin-1 characters from 160 to
+ * 255, ZC_GAP (gap between two sentences) and ZC_INDENT (paragraph
+ * indentation). The screen should not be scrolled after printing to the
+ * bottom right corner.
+ *
+ */
+void os_display_char (zchar c)
+{
+    char s[3];
+    int n;
+
+    if ((n = unix_char_text(c, s)) != 0)
+	addnstr(s, n);
 }/* os_display_char */
 
 
 /*
  * os_display_string
  *
- * Pass a string of characters to os_display_char.
+ * Display a string. Each run of text between style or font changes
+ * goes to curses in a single call.
  *
  */
 void os_display_string (const zchar *s)
 {
+    char run[256];
+    int len = 0;
     zchar c;
 
     while ((c = (unsigned char) *s++) != 0) {
@@ -253,14 +272,25 @@ void os_display_string (const zchar *s)
 
             int arg = (unsigned char) *s++;
 
+	    if (len != 0) {
+		addnstr(run, len);
+		len = 0;
+	    }
             if (c == ZC_NEW_FONT)
                 os_set_font (arg);
             if (c == ZC_NEW_STYLE)
                 os_set_text_style (arg);
 
-        } else
-	    os_display_char (c);
+        } else {
+	    if (len > (int) sizeof run - 3) {
+		addnstr(run, len);
+		len = 0;
+	    }
+	    len += unix_char_text(c, run + len);
+	}
     }
+    if (len != 0)
+	addnstr(run, len);
 
 }/* os_display_string */
 
@@ -25,18 +25,35 @@ bool is_terminator (zchar);
 /* dumb-input.c */
 bool dumb_handle_setting(const char *setting, bool show_cursor, bool startup);
 void dumb_init_input(void);
+extern bool frame_output;
+int dumb_read_input(char *s, int size, int ms);
+void dumb_end_frame(char kind);
 
 /* dumb-output.c */
+extern bool discard_screen;
 void dumb_init_output(void);
 bool dumb_output_handle_setting(const char *setting, bool show_cursor,
 				bool startup);
 void dumb_show_screen(bool show_cursor);
 void dumb_show_prompt(bool show_cursor, char line_type);
 void dumb_dump_screen(void);
+void dumb_show_scrollback(int n);
+void dumb_show_usage(void);
 void dumb_display_user_input(char *);
 void dumb_discard_old_input(int num_chars);
 void dumb_elide_more_prompt(void);
 void dumb_set_picture_cell(int row, int col, char c);
+int dumb_row_text(int r, char *s, int n);
+
+/* dumb-json.c */
+extern bool json_mode;
+void dumb_init_json(void);
+zchar dumb_json_read_key(int timeout);
+zchar dumb_json_read_line(int max, zchar *buf, int timeout);
+bool dumb_json_read_file_name(char *file_name, const char *default_name,
+			      int flag);
+bool dumb_json_confirm(const char *message);
+void dumb_json_quit(void);
 
 /* dumb-pic.c */
 void dumb_init_pictures(char *graphics_filename);
@@ -41,7 +41,13 @@ Syntax: dfrotz [options] story-file\n\
   -O   watch object locating      \t -v   show version information\n\
   -L <file> load this save file   \t -w # screen width\n\
   -m   turn off MORE prompts      \t -x   expand abbreviations g/x/z\n\
-  -p   plain ASCII output only\n"
+  -p   plain ASCII output only    \t -T # write transcript every # KB\n\
+  -F   fsync transcript writes    \t -n   no screen output\n\
+  -j   JSON input and output      \t -f   mark the end of each turn\n\
+  -b # instructions per turn      \t -B # CPU milliseconds per turn\n\
+  -M <limit>=# limit the session (instructions, time, wall, output, undo, save)\n\
+  -D # keep a trace of the last # instructions\n\
+  -c   check the story code and cache a map of its routines\n"
 
 /* A unix-like getopt, but with the names changed to avoid any problems.  */
 static int zoptind = 1;
@@ -87,6 +93,40 @@ static int user_tandy_bit = 0;
 static char *graphics_filename = NULL;
 static bool plain_ascii = FALSE;
 
+/* A turn has run too long: say so in the game's output and take the
+ * turn back.  If the game cannot undo, the interpreter stops.  */
+static int dumb_budget_hook(const char *report)
+{
+    print_string("\n[");
+    print_string(report);
+    print_string("]\n");
+    return BUDGET_UNDO;
+}
+
+/* Set a session limit given as name=value.  */
+static void dumb_set_limit(const char *setting)
+{
+    static const struct { const char *name; long *value; } limits[] = {
+	{ "instructions", &f_setup.max_instructions },
+	{ "time", &f_setup.max_cpu_time },
+	{ "wall", &f_setup.max_turn_wall_time },
+	{ "output", &f_setup.max_output },
+	{ "undo", &f_setup.max_undo_memory },
+	{ "save", &f_setup.max_save_size },
+    };
+    const char *p = strchr(setting, '=');
+    size_t i;
+
+    for (i = 0; p && i < sizeof limits / sizeof *limits; i++)
+	if (strlen(limits[i].name) == (size_t) (p - setting)
+	    && !strncmp(setting, limits[i].name, p - setting)) {
+	    *limits[i].value = atol(p + 1);
+	    return;
+	}
+    fprintf(stderr, "Unknown limit: %s\n", setting);
+    exit(1);
+}
+
 void os_process_arguments(int argc, char *argv[])
 {
     int c;
@@ -95,17 +135,26 @@ void os_process_arguments(int argc, char *argv[])
     do_more_prompts = TRUE;
     /* Parse the options */
     do {
-	c = zgetopt(argc, argv, "-aAh:iI:L:moOpPs:r:R:S:tu:vw:xZ:");
+	c = zgetopt(argc, argv, "-aAb:B:cD:fFh:iI:jL:mM:noOpPs:r:R:S:tT:u:vw:xZ:");
 	switch(c) {
 	  case 'a': f_setup.attribute_assignment = 1; break;
 	  case 'A': f_setup.attribute_testing = 1; break;
+	  case 'b': f_setup.turn_instructions = atol(zoptarg); break;
+	  case 'B': f_setup.turn_time = atol(zoptarg); break;
+	  case 'c': f_setup.code_map = 1; break;
+	  case 'D': f_setup.trace_size = atol(zoptarg); break;
+	  case 'f': frame_output = TRUE; break;
+	  case 'F': f_setup.script_sync = 1; break;
 	case 'h': user_screen_height = atoi(zoptarg); break;
 	  case 'i': f_setup.ignore_errors = 1; break;
 	  case 'I': f_setup.interpreter_number = atoi(zoptarg); break;
+	  case 'j': json_mode = TRUE; break;
 	case 'L': f_setup.restore_mode = 1;
 		  f_setup.tmp_save_name = my_strdup(zoptarg);
 		  break;
 	  case 'm': do_more_prompts = FALSE; break;
+	  case 'M': dumb_set_limit(zoptarg); break;
+	  case 'n': discard_screen = TRUE; break;
 	  case 'o': f_setup.object_movement = 1; break;
 	  case 'O': f_setup.object_locating = 1; break;
 	  case 'P': f_setup.piracy = 1; break;
@@ -115,6 +164,7 @@ void os_process_arguments(int argc, char *argv[])
 	case 's': user_random_seed = atoi(zoptarg); break;
 	  case 'S': f_setup.script_cols = atoi(zoptarg); break;
 	case 't': user_tandy_bit = 1; break;
+	  case 'T': f_setup.script_flush = atoi(zoptarg); break;
 	  case 'u': f_setup.undo_slots = atoi(zoptarg); break;
 	case 'v': print_version(); exit(2); break;
 	case 'w': user_screen_width = atoi(zoptarg); break;
@@ -127,6 +177,8 @@ void os_process_arguments(int argc, char *argv[])
 	}
     } while (c != EOF);
 
+    set_budget_hook(dumb_budget_hook);
+
     if (((argc - zoptind) != 1) && ((argc - zoptind) != 2)) {
 	printf("FROTZ V%s\tDumb interface.\n", frotz_version);
 	puts(INFORMATION);
@@ -275,8 +327,20 @@ void os_init_setup(void)
 	f_setup.undo_slots = MAX_UNDO_SLOTS;
 	f_setup.expand_abbreviations = 0;
 	f_setup.script_cols = 80;
+	f_setup.script_flush = 0;
+	f_setup.script_sync = 0;
 	f_setup.sound = 1;
 	f_setup.err_report_mode = ERR_DEFAULT_REPORT_MODE;
+	f_setup.turn_instructions = 0;
+	f_setup.turn_time = 0;
+	f_setup.max_instructions = 0;
+	f_setup.max_cpu_time = 0;
+	f_setup.max_turn_wall_time = 0;
+	f_setup.max_output = 0;
+	f_setup.max_undo_memory = 0;
+	f_setup.max_save_size = 0;
+	f_setup.trace_size = 0;
+	f_setup.code_map = 0;
 	f_setup.restore_mode = 0;
 
 }
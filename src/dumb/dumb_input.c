@@ -20,6 +20,8 @@
  */
 
 #include <string.h>
+#include <poll.h>
+#include <unistd.h>
 
 #include "dumb_frotz.h"
 
@@ -31,6 +33,9 @@ static char runtime_usage[] =
   "    \\help    Show this message.\n"
   "    \\set     Show the current values of runtime settings.\n"
   "    \\s       Show the current contents of the whole screen.\n"
+  "    \\lastN   Show the last N lines of output (default 20).\n"
+  "    \\usage   Show the resources used so far.\n"
+  "    \\trace   Write the instruction trace (see -D) to a file.\n"
   "    \\d       Discard the part of the input before the cursor.\n"
   "    \\wN      Advance clock N/10 seconds, possibly causing the current\n"
   "                and subsequent inputs to timeout.\n"
@@ -79,39 +84,143 @@ enum input_type {
     INPUT_LINE_CONTINUED,
 };
 
-/* get a character.  Exit with no fuss on EOF.  */
-static int xgetchar(void)
+/* Mark the end of the output before each input line (see
+ * dumb_end_frame), and count those lines.  */
+bool frame_output = FALSE;
+static long lines_read = 0;
+
+/* Standard input is read in large chunks into this buffer, so that a
+ * program driving us can send many lines ahead.  Lines are taken out
+ * of it one at a time.  */
+static char in_buf[16384];
+static int in_start = 0, in_end = 0;
+
+/* Throw away input up to the next newline.  */
+static bool in_skipping = FALSE;
+
+static long now_ms(void)
 {
-    int c = getchar();
-    if (c == EOF) {
-	if (feof(stdin)) {
-	    fprintf(stderr, "\nEOT\n");
-	    exit(0);
-	}
-	os_fatal(strerror(errno));
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec * 1000L + t.tv_nsec / 1000000;
+}
+
+/* Milliseconds until the deadline, or -1 if there is none.  */
+static int ms_left(long deadline)
+{
+    long ms = deadline - now_ms();
+    return deadline == 0 ? -1 : (ms > 0) ? (int) ms : 0;
+}
+
+/* Wait at most ms milliseconds (or forever, if ms is negative) for more
+ * input and add it to the buffer.  Returns FALSE if none came in time.
+ * Exit with no fuss on EOF.  */
+static bool in_fill(int ms)
+{
+    struct pollfd p;
+    ssize_t n = 0;
+
+    if (in_start == in_end)
+	in_start = in_end = 0;
+    else if (in_end == sizeof in_buf) {
+	memmove(in_buf, in_buf + in_start, in_end - in_start);
+	in_end -= in_start;
+	in_start = 0;
+    }
+
+    /* Whoever is at the other end must see all output before we wait
+     * for them, but while input is waiting, output can pile up.  */
+    p.fd = STDIN_FILENO;
+    p.events = POLLIN;
+    if (ms != 0 && (n = poll(&p, 1, 0)) == 0)
+	fflush(stdout);
+    while (n == 0 && (n = poll(&p, 1, ms)) < 0)
+	if (errno != EINTR)
+	    os_fatal(strerror(errno));
+    if (n == 0)
+	return FALSE;
+
+    while ((n = read(STDIN_FILENO, in_buf + in_end,
+		     sizeof in_buf - in_end)) < 0)
+	if (errno != EINTR)
+	    os_fatal(strerror(errno));
+    if (n == 0) {
+	fflush(stdout);
+	fprintf(stderr, "\nEOT\n");
+	exit(0);
     }
-    return c;
+    in_end += n;
+    return TRUE;
 }
 
-/* Read one line, including the newline, into s.  Safely avoids buffer
- * overruns (but that's kind of pointless because there are several
- * other places where I'm not so careful).  */
-static void dumb_getline(char *s)
+/* Read one line, including the newline, into s, which has room for
+ * size characters.  Waits at most ms milliseconds for the whole line
+ * (forever, if ms is negative) and returns -1 if it did not come in
+ * time; what came of it stays buffered.  Otherwise returns the length
+ * of the line.  The rest of a line that is too long is thrown away, and
+ * what is left of it does not end in a newline.  */
+int dumb_read_input(char *s, int size, int ms)
 {
-    int c;
-    char *p = s;
-    while (p < s + INPUT_BUFFER_SIZE - 1) {
-	if ((*p++ = xgetchar()) == '\n') {
-	    *p = '\0';
-	    return;
+    long deadline = (ms > 0) ? now_ms() + ms : 0;
+    char *nl;
+    int length;
+
+    for (;;) {
+	nl = memchr(in_buf + in_start, '\n', in_end - in_start);
+
+	if (in_skipping) {
+	    in_start = nl ? nl + 1 - in_buf : in_end;
+	    in_skipping = (nl == NULL);
+	    if (!in_skipping)
+		continue;
+	} else if (nl || in_end - in_start >= size - 1) {
+	    length = nl ? nl + 1 - (in_buf + in_start) : in_end - in_start;
+	    if (length > size - 1) {
+		length = size - 1;
+		in_skipping = TRUE;
+	    }
+	    memcpy(s, in_buf + in_start, length);
+	    s[length] = '\0';
+	    in_start += length;
+	    return length;
 	}
+
+	if (ms > 0 && (ms = deadline - now_ms()) <= 0)
+	    ms = 0;
+	if (!in_fill(ms))
+	    return -1;
     }
+}
+
+/* With -f, each input line is preceded by a frame mark: an ASCII RS
+ * character, which the game cannot print, then the number of lines read
+ * so far and a character saying what is wanted (the line type, see
+ * runtime_usage, '-' for other questions or '$' when the game is over),
+ * then a newline.  So a program that sends N lines can read N frames of
+ * output without looking for prompts.  */
+void dumb_end_frame(char kind)
+{
+    if (frame_output)
+	printf("\036%ld %c\n", lines_read, kind);
+}
 
-    p[-1] = '\n';
-    p[0] = '\0';
-    while ((c = xgetchar()) != '\n')
- 	;
-    printf("Line too long, truncated to %s\n", s - INPUT_BUFFER_SIZE);
+/* Read one line, including the newline, into s, waiting at most ms
+ * milliseconds as dumb_read_input does.  Kind says what it is for.
+ * Safely avoids buffer overruns (but that's kind of pointless because
+ * there are several other places where I'm not so careful).  */
+static bool dumb_getline(char *s, int ms, char kind)
+{
+    int length;
+
+    dumb_end_frame(kind);
+    if ((length = dumb_read_input(s, INPUT_BUFFER_SIZE, ms)) < 0)
+	return FALSE;
+    lines_read++;
+    if (s[length - 1] != '\n') {
+	s[length - 1] = '\n';
+	printf("Line too long, truncated to %s\n", s);
+    }
+    return TRUE;
 }
 
 /* Translate in place all the escape characters in s.  */
@@ -204,6 +313,7 @@ static bool dumb_read_line(char *s, char *prompt, bool show_cursor,
 			   zchar *continued_line_chars)
 {
   time_t start_time;
+  long deadline = 0;
 
   if (timeout) {
     if (time_ahead >= timeout) {
@@ -212,29 +322,31 @@ static bool dumb_read_line(char *s, char *prompt, bool show_cursor,
     }
     timeout -= time_ahead;
     start_time = time(0);
+    if (speed > 0)
+      deadline = now_ms() + (long) (timeout * 100 / speed);
   }
   time_ahead = 0;
 
   dumb_show_screen(show_cursor);
   for (;;) {
     char *command;
+    char kind = prompt ? '-' : (timeout ? "tTD" : ")>}")[type];
     if (prompt)
       fputs(prompt, stdout);
     else
-      dumb_show_prompt(show_cursor, (timeout ? "tTD" : ")>}")[type]);
-    /* Prompt only shows up after user input if we don't flush stdout */
-    fflush(stdout);
-    dumb_getline(s);
+      dumb_show_prompt(show_cursor, kind);
+    /* Prompt only shows up after user input if we don't flush stdout.
+     * Framed output is flushed only once all waiting input is used up.  */
+    if (!frame_output)
+      fflush(stdout);
+    /* Time out for real if no line comes before the deadline.  */
+    if (!dumb_getline(s, ms_left(deadline), kind)) {
+      s[0] = '\0';
+      return TRUE;
+    }
     if ((s[0] != '\\') || ((s[1] != '\0') && !islower(s[1]))) {
       /* Is not a command line.  */
       translate_special_chars(s);
-      if (timeout) {
-	int elapsed = (time(0) - start_time) * 10 * speed;
-	if (elapsed > timeout) {
-	  time_ahead = elapsed - timeout;
-	  return TRUE;
-	}
-      }
       return FALSE;
     }
     /* Commands.  */
@@ -262,6 +374,8 @@ static bool dumb_read_line(char *s, char *prompt, bool show_cursor,
 	}
 	timeout -= elapsed;
 	start_time = now;
+	if (speed > 0)
+	  deadline = now_ms() + (long) (timeout * 100 / speed);
       }
     } else if (!strcmp(command, "d")) {
       if (type != INPUT_LINE_CONTINUED)
@@ -287,14 +401,28 @@ static bool dumb_read_line(char *s, char *prompt, bool show_cursor,
 	  if (!*current_page)
 	    break;
 	  printf("HELP: Type <return> for more, or q <return> to stop: ");
-	  fflush(stdout);
-	  dumb_getline(s);
+	  dumb_getline(s, -1, '-');
 	  if (!strcmp(s, "q\n"))
 	    break;
 	}
       }
     } else if (!strcmp(command, "s")) {
 	dumb_dump_screen();
+    } else if (!strcmp(command, "usage")) {
+	dumb_show_usage();
+    } else if (!strcmp(command, "trace")) {
+	long count = trace_dump(NULL);
+	if (!tracing)
+	  fprintf(stderr, "DUMB-FROTZ: Tracing is off, start with -D\n");
+	else if (count < 0)
+	  fprintf(stderr, "DUMB-FROTZ: Cannot write %s%s\n",
+		  f_setup.story_name, EXT_TRACE);
+	else
+	  printf("Wrote %ld instructions to %s%s\n",
+		 count, f_setup.story_name, EXT_TRACE);
+    } else if (!strncmp(command, "last", 4) && (command[4] == '\0'
+	       || isdigit((unsigned char) command[4]))) {
+	dumb_show_scrollback(command[4] ? atoi(&command[4]) : 20);
     } else if (!dumb_handle_setting(command, show_cursor, FALSE)) {
       fprintf(stderr, "DUMB-FROTZ: unknown command: %s\n", s);
       fprintf(stderr, "Enter \\help to see the list of commands\n");
@@ -327,6 +455,9 @@ zchar os_read_key (int timeout, bool show_cursor)
   /* Discard any keys read for line input.  */
   read_line_buffer[0] = '\0';
 
+  if (json_mode)
+    return dumb_json_read_key(timeout);
+
   if (read_key_buffer[0] == '\0') {
     timed_out = dumb_read_line(read_key_buffer, NULL, show_cursor, timeout,
 			       INPUT_CHAR, NULL);
@@ -349,7 +480,7 @@ zchar os_read_key (int timeout, bool show_cursor)
   return c;
 }
 
-zchar os_read_line (int UNUSED (max), zchar *buf, int timeout, int UNUSED(width), int continued)
+zchar os_read_line (int max, zchar *buf, int timeout, int UNUSED(width), int continued)
 {
   char *p;
   int terminator;
@@ -359,6 +490,9 @@ zchar os_read_line (int UNUSED (max), zchar *buf, int timeout, int UNUSED(width)
   /* Discard any keys read for single key input.  */
   read_key_buffer[0] = '\0';
 
+  if (json_mode)
+    return dumb_json_read_line(max, buf, timeout);
+
   /* After timing out, discard any further input unless we're continuing.  */
   if (timed_out_last_time && !continued)
     read_line_buffer[0] = '\0';
@@ -410,12 +544,18 @@ int os_read_file_name (char *file_name, const char *default_name, int flag)
   char *tempname;
   int i;
 
+  /* Show any pending output before prompting.  */
+  batch_flush();
+
   /* If we're restoring a game before the interpreter starts,
    * our filename is already provided.  Just go ahead silently.
    */
   if (f_setup.restore_mode) {
     strcpy(file_name, default_name);
     return TRUE;
+  } else if (json_mode) {
+    if (!dumb_json_read_file_name(buf, default_name, flag))
+      return FALSE;
   } else {
     sprintf(prompt, "Please enter a filename [%s]: ", default_name);
     dumb_read_misc_line(buf, prompt);
@@ -447,6 +587,8 @@ int os_read_file_name (char *file_name, const char *default_name, int flag)
   if ((flag == FILE_SAVE || flag == FILE_SAVE_AUX || flag == FILE_RECORD)
       && ((fp = fopen(file_name, "rb")) != NULL)) {
     fclose (fp);
+    if (json_mode)
+      return dumb_json_confirm("Overwrite existing file?");
     dumb_read_misc_line(buf, "Overwrite existing file? ");
     return(tolower(buf[0]) == 'y');
   }
@@ -467,8 +609,9 @@ void dumb_init_input(void)
   if ((h_version >= V4) && (speed != 0))
     h_config |= CONFIG_TIMEDINPUT;
 
+  /* Only JSON input can carry mouse clicks.  */
   if (h_version >= V5)
-    h_flags &= ~(MOUSE_FLAG | MENU_FLAG);
+    h_flags &= ~((json_mode ? 0 : MOUSE_FLAG) | MENU_FLAG);
 }
 
 zword os_read_mouse(void)
@@ -0,0 +1,628 @@
+/*
+ * dumb_json.c - Dumb interface, JSON lines protocol
+ *
+ * This file is part of Frotz.
+ *
+ * Frotz is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * Frotz is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA 02110-1301 USA
+ * Or visit http://www.fsf.org/
+ */
+
+/* With -j, dfrotz talks to a program rather than a person.  Whenever
+ * the game waits for input, one JSON object goes to stdout on a line of
+ * its own, for example
+ *
+ *   {"type":"line","text":"...","runs":[{"style":0,"text":"..."}],
+ *    "upper":["  West of House   Score: 0"],"elapsed_ms":2,"timeout":0}
+ *
+ * "text" is what the main window printed since the last input, taken
+ * from the scrollback history, and "runs" is the same text split up by
+ * text style.  "upper" holds the rows above the main window (status
+ * line and upper window).  "type" is line, char, file (a file name is
+ * wanted; "purpose" and "default" say which), confirm ("message" says
+ * what) or quit.
+ *
+ * Each answer is a JSON object on one line of stdin:
+ *
+ *   {"line":"open mailbox"}        line input
+ *   {"key":"a"}, {"key":"up"}      a single key (or line terminator)
+ *   {"click":1,"x":10,"y":3}       mouse click (2 for a double click)
+ *   {"hotkey":"undo"}              one of the standard hot keys
+ *   {"timeout":true}               let timed input run out
+ *   {"file":"name"}, {"cancel":true}, {"confirm":true}
+ *   {"save":"name"}, {"restore":"name"}
+ *
+ * The last two type "save" or "restore" and then answer the game's
+ * questions for a file name (and whether to overwrite it) themselves.
+ * Anything else is answered with an object of type error, after which
+ * the next line is read.  */
+
+#include "dumb_frotz.h"
+
+/* Talk JSON on stdin and stdout.  */
+bool json_mode = FALSE;
+
+typedef struct {
+    char *buf;
+    int len, space;
+} json_buffer;
+
+/* The object being written, and the "runs" array that goes into it.  */
+static json_buffer out, runs;
+
+#define JSON_MAX_FIELDS 8
+
+/* The fields of the last input object.  String values are converted to
+ * Latin-1; other values are kept as written.  */
+static int field_count;
+static char *field_name[JSON_MAX_FIELDS];
+static char *field_value[JSON_MAX_FIELDS];
+static char field_space[2 * INPUT_BUFFER_SIZE];
+
+/* How far main window text has been reported: the line, numbered as in
+ * scrollback_started, and how many characters of it.  */
+static long reported_line = 1;
+static int reported_length = 0;
+static int reported_style = 0;
+
+/* Rows above the main window, as of the last time it was current.  */
+static int upper_rows = 0;
+
+/* File name from a save or restore request, and whether to overwrite
+ * it without asking.  */
+static char pending_file[MAX_FILE_NAME + 1];
+static bool file_pending = FALSE;
+static bool confirm_pending = FALSE;
+
+static struct timespec turn_start;
+
+static struct {
+    const char *name;
+    zchar key;
+} key_names[] = {
+    {"return", ZC_RETURN}, {"escape", ZC_ESCAPE},
+    {"backspace", ZC_BACKSPACE}, {"up", ZC_ARROW_UP},
+    {"down", ZC_ARROW_DOWN}, {"left", ZC_ARROW_LEFT},
+    {"right", ZC_ARROW_RIGHT},
+    {"record", ZC_HKEY_RECORD}, {"playback", ZC_HKEY_PLAYBACK},
+    {"seed", ZC_HKEY_SEED}, {"undo", ZC_HKEY_UNDO},
+    {"restart", ZC_HKEY_RESTART}, {"quit", ZC_HKEY_QUIT},
+    {"debug", ZC_HKEY_DEBUG}, {"help", ZC_HKEY_HELP},
+    {NULL, 0}
+};
+
+/* Indexed by the FILE_ flags of os_read_file_name.  */
+static char *file_purposes[] = {
+    "restore", "save", "script", "playback", "record", "load_aux",
+    "save_aux",
+};
+
+static void put_char(json_buffer *b, char c)
+{
+    if (b->len == b->space) {
+	b->space = b->space ? 2 * b->space : 4096;
+	if ((b->buf = realloc(b->buf, b->space)) == NULL)
+	    os_fatal("Out of memory");
+    }
+    b->buf[b->len++] = c;
+}
+
+static void put_raw(json_buffer *b, const char *s)
+{
+    while (*s)
+	put_char(b, *s++);
+}
+
+/* Write a Latin-1 character as UTF-8, escaped as JSON requires.  */
+static void put_zchar(json_buffer *b, zchar c)
+{
+    char s[8];
+
+    if (c == '"' || c == '\\') {
+	put_char(b, '\\'); put_char(b, c);
+    } else if (c == '\n')
+	put_raw(b, "\\n");
+    else if (c < 0x20) {
+	sprintf(s, "\\u%04x", c);
+	put_raw(b, s);
+    } else if (c < 0x80)
+	put_char(b, c);
+    else {
+	put_char(b, 0xc0 | (c >> 6));
+	put_char(b, 0x80 | (c & 0x3f));
+    }
+}
+
+static void put_string(json_buffer *b, const char *s)
+{
+    put_char(b, '"');
+    while (*s)
+	put_zchar(b, (unsigned char) *s++);
+    put_char(b, '"');
+}
+
+/* Start a field of the object being written.  */
+static void put_field(const char *name)
+{
+    if (out.buf[out.len - 1] != '{')
+	put_char(&out, ',');
+    put_string(&out, name);
+    put_char(&out, ':');
+}
+
+static void put_number(const char *name, long value)
+{
+    char s[24];
+
+    put_field(name);
+    sprintf(s, "%ld", value);
+    put_raw(&out, s);
+}
+
+/* Finish the object and send it.  It is flushed when input is awaited.  */
+static void json_send(void)
+{
+    put_raw(&out, "}\n");
+    fwrite(out.buf, 1, out.len, stdout);
+    out.len = 0;
+}
+
+static void json_error(const char *message)
+{
+    put_char(&out, '{');
+    put_field("type");
+    put_string(&out, "error");
+    put_field("message");
+    put_string(&out, message);
+    json_send();
+}
+
+/* Add a character of main window text to "text" and to the current
+ * run, opening a new run if there is none.  */
+static void text_char(zchar c, bool *in_run)
+{
+    char s[40];
+
+    put_zchar(&out, c);
+    if (!*in_run) {
+	sprintf(s, "%s{\"style\":%d,\"text\":\"",
+	    runs.len ? "," : "", reported_style);
+	put_raw(&runs, s);
+	*in_run = TRUE;
+    }
+    put_zchar(&runs, c);
+}
+
+/* Report what the main window printed since last time.  */
+static void put_main_text(void)
+{
+    long started = scrollback_started();
+    int count = scrollback_count();
+    bool in_run = FALSE;
+    const zchar *text;
+    int length = 0;
+    long line;
+    int i;
+
+    /* So much was printed that the start is gone.  */
+    if (reported_line <= started - count) {
+	put_field("truncated");
+	put_raw(&out, "true");
+	reported_line = started - count + 1;
+	reported_length = 0;
+    }
+
+    put_field("text");
+    put_char(&out, '"');
+    runs.len = 0;
+
+    for (line = reported_line; line <= started; line++) {
+	text = scrollback_line(count - 1 - (int) (started - line), &length);
+	i = (line == reported_line) ? reported_length : 0;
+	for (; i < length; i++) {
+	    zchar c = text[i];
+	    if (c == ZC_NEW_STYLE || c == ZC_NEW_FONT) {
+		if (c == ZC_NEW_STYLE && text[i + 1] != reported_style) {
+		    reported_style = text[i + 1];
+		    if (in_run)
+			put_raw(&runs, "\"}");
+		    in_run = FALSE;
+		}
+		i++;
+	    } else if (c == ZC_GAP) {
+		text_char(' ', &in_run); text_char(' ', &in_run);
+	    } else if (c == ZC_INDENT) {
+		text_char(' ', &in_run); text_char(' ', &in_run);
+		text_char(' ', &in_run);
+	    } else if (c >= ZC_LATIN1_MIN || (c >= 32 && c <= 126))
+		text_char(c, &in_run);
+	}
+	if (line < started)
+	    text_char('\n', &in_run);
+    }
+
+    put_char(&out, '"');
+    if (in_run)
+	put_raw(&runs, "\"}");
+
+    put_field("runs");
+    put_char(&out, '[');
+    for (i = 0; i < runs.len; i++)
+	put_char(&out, runs.buf[i]);
+    put_char(&out, ']');
+
+    reported_line = started;
+    reported_length = length;
+}
+
+/* Start the object for a prompt of the given type.  */
+static void json_begin(const char *type)
+{
+    char row[INPUT_BUFFER_SIZE];
+    struct timespec now;
+    int r;
+
+    put_char(&out, '{');
+    put_field("type");
+    put_string(&out, type);
+
+    put_main_text();
+
+    if (cwin == 0)
+	upper_rows = curwinrec()->y_pos - 1;
+    put_field("upper");
+    put_char(&out, '[');
+    for (r = 0; r < upper_rows && r < h_screen_rows; r++) {
+	row[dumb_row_text(r, row, sizeof row - 1)] = '\0';
+	if (r)
+	    put_char(&out, ',');
+	put_string(&out, row);
+    }
+    put_char(&out, ']');
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    put_number("elapsed_ms", (now.tv_sec - turn_start.tv_sec) * 1000
+	       + (now.tv_nsec - turn_start.tv_nsec) / 1000000);
+}
+
+static int hex_digit(char c)
+{
+    if (isdigit((unsigned char) c))
+	return c - '0';
+    if (c >= 'a' && c <= 'f')
+	return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+	return c - 'A' + 10;
+    return -1;
+}
+
+/* Parse one string or literal of an input object into *p.  Returns a
+ * pointer past it, or NULL if it is malformed.  */
+static const char *parse_value(const char *s, char **p, char *end,
+			       bool literal_ok)
+{
+    char *q = *p;
+    int c, i, d;
+
+    if (*s != '"') {
+	if (!literal_ok)
+	    return NULL;
+	while (isalnum((unsigned char) *s) || *s == '-' || *s == '+'
+	       || *s == '.')
+	    if (q < end)
+		*q++ = *s++;
+	    else
+		return NULL;
+	if (q == *p)
+	    return NULL;
+	*q++ = '\0';
+	*p = q;
+	return s;
+    }
+
+    for (s++; *s != '"'; ) {
+	if (*s == '\0' || q >= end)
+	    return NULL;
+	c = (unsigned char) *s++;
+	if (c == '\\') {
+	    switch (c = *s++) {
+	    case 'n': c = '\n'; break;
+	    case 't': c = '\t'; break;
+	    case 'r': c = '\r'; break;
+	    case 'b': c = '\b'; break;
+	    case 'f': c = '\f'; break;
+	    case '"': case '\\': case '/': break;
+	    case 'u':
+		for (c = 0, i = 0; i < 4; i++) {
+		    if ((d = hex_digit(*s++)) < 0)
+			return NULL;
+		    c = 16 * c + d;
+		}
+		break;
+	    default: return NULL;
+	    }
+	} else if (c >= 0xc0 && c < 0xe0 && (*s & 0xc0) == 0x80)
+	    c = ((c & 0x1f) << 6) | (*s++ & 0x3f);
+	else if (c >= 0x80) {
+	    while ((*s & 0xc0) == 0x80)
+		s++;
+	    c = '?';
+	}
+	*q++ = (c > 0xff) ? '?' : c;
+    }
+    *q++ = '\0';
+    *p = q;
+    return s + 1;
+}
+
+/* Parse a flat JSON object into field_name and field_value.  */
+static bool json_parse(const char *s)
+{
+    char *p = field_space;
+    char *end = field_space + sizeof field_space - 1;
+
+    field_count = 0;
+
+    while (isspace((unsigned char) *s)) s++;
+    if (*s++ != '{')
+	return FALSE;
+    while (isspace((unsigned char) *s)) s++;
+    if (*s == '}')
+	return TRUE;
+
+    for (;;) {
+	if (field_count == JSON_MAX_FIELDS)
+	    return FALSE;
+
+	field_name[field_count] = p;
+	if ((s = parse_value(s, &p, end, FALSE)) == NULL)
+	    return FALSE;
+	while (isspace((unsigned char) *s)) s++;
+	if (*s++ != ':')
+	    return FALSE;
+	while (isspace((unsigned char) *s)) s++;
+	field_value[field_count] = p;
+	if ((s = parse_value(s, &p, end, TRUE)) == NULL)
+	    return FALSE;
+	field_count++;
+
+	while (isspace((unsigned char) *s)) s++;
+	if (*s == '}')
+	    return TRUE;
+	if (*s++ != ',')
+	    return FALSE;
+	while (isspace((unsigned char) *s)) s++;
+    }
+}
+
+static const char *json_get(const char *name)
+{
+    int i;
+    for (i = 0; i < field_count; i++)
+	if (!strcmp(field_name[i], name))
+	    return field_value[i];
+    return NULL;
+}
+
+static bool json_true(const char *name)
+{
+    const char *v = json_get(name);
+    return v != NULL && strcmp(v, "false") && strcmp(v, "0")
+	&& strcmp(v, "null");
+}
+
+/* Read the answer to the prompt just sent.  Input is shared with the
+ * ordinary dumb interface, which also takes care of EOF.  */
+static void json_read(void)
+{
+    char s[INPUT_BUFFER_SIZE];
+    int length;
+
+    for (;;) {
+	length = dumb_read_input(s, sizeof s, -1);
+	if (s[length - 1] != '\n')
+	    json_error("input too long");
+	else if (!json_parse(s))
+	    json_error("malformed input");
+	else
+	    break;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &turn_start);
+}
+
+/* Translate a key, click or hot key in the input.  Returns ZC_BAD if
+ * there is none.  */
+static zchar json_key(void)
+{
+    const char *v, *x, *y;
+    int i;
+
+    if ((v = json_get("click")) != NULL) {
+	x = json_get("x"); y = json_get("y");
+	mouse_x = x ? atoi(x) : 1;
+	mouse_y = y ? atoi(y) : 1;
+	return (atoi(v) == 2) ? ZC_DOUBLE_CLICK : ZC_SINGLE_CLICK;
+    }
+    if ((v = json_get("key")) != NULL) {
+	if (v[0] != '\0' && v[1] == '\0')
+	    return (unsigned char) v[0];
+	if (v[0] == 'f' && isdigit((unsigned char) v[1])) {
+	    i = atoi(v + 1);
+	    if (i >= 1 && i <= ZC_FKEY_MAX - ZC_FKEY_MIN + 1)
+		return ZC_FKEY_MIN + i - 1;
+	}
+    } else if ((v = json_get("hotkey")) == NULL)
+	return ZC_BAD;
+    for (i = 0; key_names[i].name; i++)
+	if (!strcmp(v, key_names[i].name))
+	    return key_names[i].key;
+    return ZC_BAD;
+}
+
+/* Turn a save or restore request into the command for it.  */
+static const char *json_request(void)
+{
+    const char *v, *command;
+
+    if ((v = json_get("save")) != NULL)
+	command = "save";
+    else if ((v = json_get("restore")) != NULL)
+	command = "restore";
+    else
+	return NULL;
+    strncpy(pending_file, v, MAX_FILE_NAME);
+    pending_file[MAX_FILE_NAME] = '\0';
+    file_pending = TRUE;
+    return command;
+}
+
+zchar dumb_json_read_key(int timeout)
+{
+    const char *v;
+    zchar key;
+
+    file_pending = FALSE;
+
+    json_begin("char");
+    put_number("timeout", timeout);
+    json_send();
+
+    for (;;) {
+	json_read();
+	if (timeout && json_true("timeout"))
+	    return ZC_TIME_OUT;
+	if ((key = json_key()) != ZC_BAD)
+	    return key;
+	if ((v = json_get("line")) != NULL)
+	    return v[0] ? (unsigned char) v[0] : ZC_RETURN;
+	json_error("a key is wanted");
+    }
+}
+
+zchar dumb_json_read_line(int max, zchar *buf, int timeout)
+{
+    int start = strlen((char *) buf), length = start;
+    const char *v;
+    zchar key;
+
+    file_pending = FALSE;
+
+    json_begin("line");
+    put_number("timeout", timeout);
+    json_send();
+
+    for (;;) {
+	json_read();
+	if (timeout && json_true("timeout"))
+	    return ZC_TIME_OUT;
+	if ((v = json_request()) != NULL || (v = json_get("line")) != NULL)
+	    key = ZC_RETURN;
+	else if ((key = json_key()) != ZC_BAD && is_terminator(key))
+	    v = "";
+	else {
+	    json_error("a line or a terminating key is wanted");
+	    continue;
+	}
+	break;
+    }
+
+    for (; *v && length < max; v++)
+	if ((unsigned char) *v >= ZC_ASCII_MIN && *v != ZC_BAD)
+	    buf[length++] = *v;
+    buf[length] = 0;
+
+    dumb_display_user_input((char *) buf + start);
+
+    /* The screen module puts the whole line into the scrollback after
+     * this, and a newline if it was ended by return.  Whoever typed it
+     * does not need to hear either of them back.  */
+    if (cwin == 0) {
+	if (key == ZC_RETURN) {
+	    reported_line++;
+	    reported_length = 0;
+	} else
+	    reported_length += length;
+    }
+
+    return key;
+}
+
+bool dumb_json_read_file_name(char *file_name, const char *default_name,
+			      int flag)
+{
+    const char *v;
+
+    confirm_pending = file_pending;
+    if (file_pending) {
+	file_pending = FALSE;
+	strcpy(file_name, pending_file[0] ? pending_file : default_name);
+	return TRUE;
+    }
+
+    json_begin("file");
+    put_field("purpose");
+    put_string(&out, (flag >= FILE_RESTORE && flag <= FILE_SAVE_AUX)
+	       ? file_purposes[flag] : "");
+    put_field("default");
+    put_string(&out, default_name);
+    json_send();
+
+    for (;;) {
+	json_read();
+	if (json_true("cancel"))
+	    return FALSE;
+	if ((v = json_get("file")) != NULL) {
+	    if (strlen(v) > MAX_FILE_NAME) {
+		json_error("file name too long");
+		continue;
+	    }
+	    strcpy(file_name, v[0] ? v : default_name);
+	    return TRUE;
+	}
+	json_error("a file name is wanted");
+    }
+}
+
+bool dumb_json_confirm(const char *message)
+{
+    if (confirm_pending) {
+	confirm_pending = FALSE;
+	return TRUE;
+    }
+
+    json_begin("confirm");
+    put_field("message");
+    put_string(&out, message);
+    json_send();
+
+    for (;;) {
+	json_read();
+	if (json_get("confirm") != NULL)
+	    return json_true("confirm");
+	json_error("confirm is wanted");
+    }
+}
+
+/* Report the last of the output when the game ends.  */
+void dumb_json_quit(void)
+{
+    json_begin("quit");
+    json_send();
+}
+
+void dumb_init_json(void)
+{
+    clock_gettime(CLOCK_MONOTONIC, &turn_start);
+}
@@ -29,6 +29,9 @@ static bool show_pictures = TRUE;
 static bool visual_bell = TRUE;
 static bool plain_ascii = FALSE;
 
+/* Throw away all screen output; only transcripts and the like remain.  */
+bool discard_screen = FALSE;
+
 static char latin1_to_ascii[] =
   "    !   c   L   >o< Y   |   S   ''  C   a   <<  not -   R   _   "
   "^0  +/- ^2  ^3  '   my  P   .   ,   ^1  o   >>  1/4 1/2 3/4 ?   "
@@ -63,6 +66,14 @@ static int current_style = 0;
 /* Which cells have changed (1 byte per cell).  */
 static char *screen_changes;
 
+/* For each row, the first and last column that may have changed.  All
+ * changed cells lie in these ranges, so only they need scanning.  */
+static int *dirty_first, *dirty_last;
+
+/* Screen output is collected here and written in one go.  */
+static char *out_buf;
+static int out_len = 0, out_space = 0;
+
 static int cursor_row = 0, cursor_col = 0;
 
 /* Compression styles.  */
@@ -86,6 +97,39 @@ static char *dumb_changes_row(int r)
     return screen_changes + r * h_screen_cols;
 }
 
+/* Note that cells first..last of a row may have changed.  */
+static void dumb_mark_dirty(int r, int first, int last)
+{
+    if (first < dirty_first[r])
+	dirty_first[r] = first;
+    if (last > dirty_last[r])
+	dirty_last[r] = last;
+}
+
+static void out_char(char c)
+{
+    if (out_len == out_space) {
+	out_space = out_space ? 2 * out_space : 4096;
+	if ((out_buf = realloc(out_buf, out_space)) == NULL)
+	    os_fatal("Out of memory");
+    }
+    out_buf[out_len++] = c;
+}
+
+static void out_string(const char *s)
+{
+    while (*s)
+	out_char(*s++);
+}
+
+/* Write the collected output to stdout.  */
+static void out_flush(void)
+{
+    if (out_len)
+	fwrite(out_buf, 1, out_len, stdout);
+    out_len = 0;
+}
+
 int os_char_width (zchar z)
 {
     if (plain_ascii && z >= ZC_LATIN1_MIN) {
@@ -126,7 +170,8 @@ bool os_repaint_window(int UNUSED(win), int UNUSED(ypos_old),
 /* Set a cell and update screen_changes.  */
 static void dumb_set_cell(int row, int col, cell c)
 {
-    dumb_changes_row(row)[col] = (c != dumb_row(row)[col]);
+    if ((dumb_changes_row(row)[col] = (c != dumb_row(row)[col])))
+	dumb_mark_dirty(row, col, col);
     dumb_row(row)[col] = c;
 }
 
@@ -135,13 +180,32 @@ void dumb_set_picture_cell(int row, int col, char c)
     dumb_set_cell(row, col, make_cell(PICTURE_STYLE, c));
 }
 
-/* Copy a cell and copy its changedness state.
+/* Copy columns left..right of a row and their changedness state.
  * This is used for scrolling.  */
-static void dumb_copy_cell(int dest_row, int dest_col,
-			   int src_row, int src_col)
+static void dumb_copy_row(int dest_row, int src_row, int left, int right)
+{
+    int width = right - left + 1;
+
+    memmove(dumb_row(dest_row) + left, dumb_row(src_row) + left,
+	    width * sizeof(cell));
+    memmove(dumb_changes_row(dest_row) + left, dumb_changes_row(src_row) + left,
+	    width);
+
+    if (dirty_first[src_row] <= right && dirty_last[src_row] >= left)
+	dumb_mark_dirty(dest_row,
+	    (dirty_first[src_row] > left) ? dirty_first[src_row] : left,
+	    (dirty_last[src_row] < right) ? dirty_last[src_row] : right);
+}
+
+/* Move rows of full width, along with their dirty ranges.  */
+static void dumb_move_rows(int dest_row, int src_row, int rows)
 {
-    dumb_row(dest_row)[dest_col] = dumb_row(src_row)[src_col];
-    dumb_changes_row(dest_row)[dest_col] = dumb_changes_row(src_row)[src_col];
+    memmove(dumb_row(dest_row), dumb_row(src_row),
+	    rows * h_screen_cols * sizeof(cell));
+    memmove(dumb_changes_row(dest_row), dumb_changes_row(src_row),
+	    rows * h_screen_cols);
+    memmove(dirty_first + dest_row, dirty_first + src_row, rows * sizeof(int));
+    memmove(dirty_last + dest_row, dirty_last + src_row, rows * sizeof(int));
 }
 
 void os_set_text_style(int x)
@@ -223,30 +287,43 @@ void os_display_string (const zchar *s)
 void os_erase_area (int top, int left, int bottom, int right, int UNUSED (win))
 {
     int row, col;
+    cell blank = make_cell(current_style, ' ');
     top--; left--; bottom--; right--;
     for (row = top; row <= bottom; row++) {
-	for (col = left; col <= right; col++)
-	    dumb_set_cell(row, col, make_cell(current_style, ' '));
+	cell *data = dumb_row(row);
+	char *changes = dumb_changes_row(row);
+	bool changed = FALSE;
+	for (col = left; col <= right; col++) {
+	    changed |= (changes[col] = (data[col] != blank));
+	    data[col] = blank;
+	}
+	if (changed)
+	    dumb_mark_dirty(row, left, right);
     }
 }
 
 void os_scroll_area (int top, int left, int bottom, int right, int units)
 {
-    int row, col;
+    int row;
+    bool full_width;
 
     top--; left--; bottom--; right--;
 
+    full_width = (left == 0 && right == h_screen_cols - 1);
+
     if (units > 0) {
-	for (row = top; row <= bottom - units; row++) {
-	    for (col = left; col <= right; col++)
-		dumb_copy_cell(row, col, row + units, col);
-	}
+	if (full_width && bottom - units >= top)
+	    dumb_move_rows(top, top + units, bottom - units - top + 1);
+	else
+	    for (row = top; row <= bottom - units; row++)
+		dumb_copy_row(row, row + units, left, right);
 	os_erase_area(bottom - units + 2, left + 1, bottom + 1, right + 1, -1 );
     } else if (units < 0) {
-	for (row = bottom; row >= top - units; row--) {
-	    for (col = left; col <= right; col++)
-		dumb_copy_cell(row, col, row + units, col);
-	}
+	if (full_width && bottom + units >= top)
+	    dumb_move_rows(top - units, top, bottom + units - top + 1);
+	else
+	    for (row = bottom; row >= top - units; row--)
+		dumb_copy_row(row, row + units, left, right);
 	os_erase_area(top + 1, left + 1, top - units, right + 1 , -1);
     }
 }
@@ -262,26 +339,26 @@ int os_font_data(int font, int *height, int *width)
 void os_set_colour (int UNUSED (x), int UNUSED (y)) {}
 void os_set_font (int UNUSED (x)) {}
 
-/* Print a cell to stdout.  */
+/* Print a cell to the output buffer.  */
 static void show_cell(cell cel)
 {
     char c = cell_char(cel);
     switch (cell_style(cel)) {
     case 0:
-	putchar(c);
+	out_char(c);
 	break;
     case PICTURE_STYLE:
-	putchar(show_pictures ? c : ' ');
+	out_char(show_pictures ? c : ' ');
 	break;
     case REVERSE_STYLE:
 	if (c == ' ')
-	    putchar(rv_blank_char);
+	    out_char(rv_blank_char);
 	else
 	    switch (rv_mode) {
-	    case RV_NONE: putchar(c); break;
-	    case RV_CAPS: putchar(toupper(c)); break;
-	    case RV_UNDERLINE: putchar('_'); putchar('\b'); putchar(c); break;
-	    case RV_DOUBLESTRIKE: putchar(c); putchar('\b'); putchar(c); break;
+	    case RV_NONE: out_char(c); break;
+	    case RV_CAPS: out_char(toupper(c)); break;
+	    case RV_UNDERLINE: out_char('_'); out_char('\b'); out_char(c); break;
+	    case RV_DOUBLESTRIKE: out_char(c); out_char('\b'); out_char(c); break;
 	    }
 	break;
     }
@@ -297,16 +374,19 @@ static bool will_print_blank(cell c)
 
 static void show_line_prefix(int row, char c)
 {
-    if (show_line_numbers)
-	printf((row == -1) ? ".." : "%02d", (row + 1) % 100);
+    if (show_line_numbers) {
+	char number[4];
+	sprintf(number, (row == -1) ? ".." : "%02d", (row + 1) % 100);
+	out_string(number);
+    }
     if (show_line_types)
-	putchar(c);
+	out_char(c);
     /* Add a separator char (unless there's nothing to separate).  */
     if (show_line_numbers || show_line_types)
-	putchar(' ');
+	out_char(' ');
 }
 
-/* Print a row to stdout.  */
+/* Print a row to the output buffer.  */
 static void show_row(int r)
 {
     if (r == -1) {
@@ -323,23 +403,43 @@ static void show_row(int r)
 	for (c = 0; c <= last; c++)
 	    show_cell(dumb_row(r)[c]);
     }
-    putchar('\n');
+    out_char('\n');
 }
 
 /* Print the part of the cursor row before the cursor.  */
 void dumb_show_prompt(bool show_cursor, char line_type)
 {
     int i;
+    if (discard_screen || json_mode)
+	return;
     show_line_prefix(show_cursor ? cursor_row : -1, line_type);
     if (show_cursor) {
 	for (i = 0; i < cursor_col; i++)
 	    show_cell(dumb_row(cursor_row)[i]);
     }
+    out_flush();
 }
 
 static void mark_all_unchanged(void)
 {
-    memset(screen_changes, 0, screen_cells);
+    int r;
+    for (r = 0; r < h_screen_rows; r++) {
+	if (dirty_first[r] <= dirty_last[r])
+	    memset(dumb_changes_row(r) + dirty_first[r], 0,
+		   dirty_last[r] - dirty_first[r] + 1);
+	dirty_first[r] = h_screen_cols;
+	dirty_last[r] = -1;
+    }
+}
+
+/* Mark every cell of a given style as changed.  */
+static void mark_style_changed(int style)
+{
+    int r, i;
+    for (i = 0; i < screen_cells; i++)
+	screen_changes[i] = (cell_style(screen_data[i]) == style);
+    for (r = 0; r < h_screen_rows; r++)
+	dumb_mark_dirty(r, 0, h_screen_cols - 1);
 }
 
 /* Check if a cell is a blank or will display as one.
@@ -362,11 +462,15 @@ void dumb_show_screen(bool show_cursor)
     int r, c, first, last;
     char changed_rows[0x100];
 
+    if (discard_screen || json_mode)
+	return;
+
     /* Easy case */
     if (compression_mode == COMPRESSION_NONE) {
 	for (r = hide_lines; r < h_screen_rows; r++)
 	    show_row(r);
 	mark_all_unchanged();
+	out_flush();
 	return;
     }
 
@@ -374,10 +478,10 @@ void dumb_show_screen(bool show_cursor)
     first = last = -1;
     memset(changed_rows, 0, h_screen_rows);
     for (r = hide_lines; r < h_screen_rows; r++) {
-	for (c = 0; c < h_screen_cols; c++)
+	for (c = dirty_first[r]; c <= dirty_last[r]; c++)
 	    if (dumb_changes_row(r)[c] && !is_blank(dumb_row(r)[c]))
 		break;
-	changed_rows[r] = (c != h_screen_cols);
+	changed_rows[r] = (c <= dirty_last[r]);
 	if (changed_rows[r]) {
 	    first = (first != -1) ? first : r;
 	    last = r;
@@ -417,6 +521,7 @@ void dumb_show_screen(bool show_cursor)
     }
 
     mark_all_unchanged();
+    out_flush();
 }
 
 /* Unconditionally show whole screen.  For \s user command.  */
@@ -425,24 +530,113 @@ void dumb_dump_screen(void)
     int r;
     for (r = 0; r < h_screen_height; r++)
 	show_row(r);
+    out_flush();
+}
+
+/* Copy the characters of row R to S, at most N of them, and return how
+ * many there are without trailing blanks.  */
+int dumb_row_text(int r, char *s, int n)
+{
+    int c, length = 0;
+
+    if (n > h_screen_cols)
+	n = h_screen_cols;
+    for (c = 0; c < n; c++)
+	if ((s[c] = cell_char(dumb_row(r)[c])) != ' ')
+	    length = c + 1;
+    return length;
+}
+
+/* Show the last N lines of the scrollback history, leaving out the
+ * current line if nothing has been printed on it yet.  For \last user
+ * command.  */
+void dumb_show_scrollback(int n)
+{
+    const zchar *text;
+    int count = scrollback_count();
+    int length, i, j;
+
+    scrollback_line(count - 1, &length);
+    if (length == 0)
+	count--;
+    for (i = (n < count) ? count - n : 0; i < count; i++) {
+	text = scrollback_line(i, &length);
+	for (j = 0; j < length; j++) {
+	    zchar c = text[j];
+	    if (c == ZC_NEW_STYLE || c == ZC_NEW_FONT)
+		j++;
+	    else if (c == ZC_GAP)
+		out_string("  ");
+	    else if (c == ZC_INDENT)
+		out_string("   ");
+	    else if (c >= ZC_LATIN1_MIN && plain_ascii) {
+		char *ptr = latin1_to_ascii + 4 * (c - ZC_LATIN1_MIN);
+		do
+		    out_char(*ptr++);
+		while (*ptr != ' ');
+	    } else if (c >= ZC_LATIN1_MIN || (c >= 32 && c <= 126))
+		out_char(c);
+	}
+	out_char('\n');
+    }
+    out_flush();
+}
+
+/* Show what the session has used so far.  */
+void dumb_show_usage(void)
+{
+    usage_t u;
+    char s[200];
+
+    get_usage(&u);
+    snprintf(s, sizeof s, "Instructions: %ld (this turn %ld, most in a turn %ld)\n",
+	     u.instructions, u.turn_instructions, u.peak_turn_instructions);
+    out_string(s);
+    snprintf(s, sizeof s, "CPU time: %ld ms (this turn %ld ms, most in a turn %ld ms)\n",
+	     u.cpu_time, u.turn_time, u.peak_turn_time);
+    out_string(s);
+    snprintf(s, sizeof s, "Wall time: %ld s (this turn %ld ms, most in a turn %ld ms)\n",
+	     u.wall_time, u.turn_wall_time, u.peak_turn_wall_time);
+    out_string(s);
+    snprintf(s, sizeof s, "Turns: %ld\n", u.turns);
+    out_string(s);
+    snprintf(s, sizeof s, "Undo memory: %ld bytes (most %ld bytes)\n",
+	     u.undo_memory, u.peak_undo_memory);
+    out_string(s);
+    snprintf(s, sizeof s, "Output: %ld characters\n", u.output);
+    out_string(s);
+    snprintf(s, sizeof s, "Saves: %ld (last %ld bytes, largest %ld bytes)\n",
+	     u.saves, u.save_size, u.peak_save_size);
+    out_string(s);
+    out_flush();
 }
 
 /* Called when it's time for a more prompt but user has them turned off.  */
 void dumb_elide_more_prompt(void)
 {
+    if (discard_screen || json_mode)
+	return;
     dumb_show_screen(FALSE);
     if (compression_mode == COMPRESSION_SPANS && hide_lines == 0) {
 	show_row(-1);
+	out_flush();
     }
 }
 
 void os_reset_screen(void)
 {
-    dumb_show_screen(FALSE);
+    if (json_mode)
+	dumb_json_quit();
+    else {
+	dumb_show_screen(FALSE);
+	dumb_end_frame('$');
+    }
 }
 
 void os_beep (int volume)
 {
+    if (discard_screen || json_mode)
+	return;
     if (visual_bell)
 	printf("[%s-PITCHED BEEP]\n", (volume == 1) ? "HIGH" : "LOW");
     else
@@ -469,15 +663,13 @@ bool dumb_output_handle_setting(const char *setting, bool show_cursor,
 				bool startup)
 {
     char *p;
-    int i;
 
     if (!strncmp(setting, "pb", 2)) {
 	toggle(&show_pictures, setting[2]);
 	printf("Picture outlines display %s\n", show_pictures ? "ON" : "OFF");
 	if (startup)
 	    return TRUE;
-	for (i = 0; i < screen_cells; i++)
-	    screen_changes[i] = (cell_style(screen_data[i]) == PICTURE_STYLE);
+	mark_style_changed(PICTURE_STYLE);
 	dumb_show_screen(show_cursor);
     } else if (!strncmp(setting, "vb", 2)) {
 	toggle(&visual_bell, setting[2]);
@@ -514,9 +706,9 @@ bool dumb_output_handle_setting(const char *setting, bool show_cursor,
 
 	for (p = "sample reverse text"; *p; p++)
 	    show_cell(make_cell(REVERSE_STYLE, *p));
-	putchar('\n');
-	for (i = 0; i < screen_cells; i++)
-	    screen_changes[i] = (cell_style(screen_data[i]) == REVERSE_STYLE);
+	out_char('\n');
+	out_flush();
+	mark_style_changed(REVERSE_STYLE);
 	dumb_show_screen(show_cursor);
     } else if (!strcmp(setting, "set")) {
 
@@ -531,14 +723,24 @@ bool dumb_output_handle_setting(const char *setting, bool show_cursor,
 	    rv_names[rv_mode], rv_blank_char);
 	for (p = "sample reverse text"; *p; p++)
 	    show_cell(make_cell(REVERSE_STYLE, *p));
-	putchar('\n');
+	out_char('\n');
+	out_flush();
     } else
 	return FALSE;
     return TRUE;
 }
 
+/* Apply a batch of screen output to the in-memory screen.  */
+static void dumb_render_batch(const batch_event_t *events, int count,
+			      const zchar *text)
+{
+    batch_replay(events, count, text);
+}
+
 void dumb_init_output(void)
 {
+    int r;
+
     if (h_version == V3) {
 	h_config |= CONFIG_SPLITSCREEN;
 	h_flags &= ~OLD_SOUND_FLAG;
@@ -554,11 +756,35 @@ void dumb_init_output(void)
 
     h_font_width = 1; h_font_height = 1;
 
+    /* Without ASCII transliteration every character is one cell.  */
+    text_width_mode = plain_ascii ? WIDTH_CHARS : WIDTH_FIXED;
+
     if (show_line_types == -1)
 	show_line_types = h_version > 3;
 
     screen_data = malloc(screen_cells * sizeof(cell));
     screen_changes = malloc(screen_cells);
+    dirty_first = malloc(h_screen_rows * sizeof(int));
+    dirty_last = malloc(h_screen_rows * sizeof(int));
+    for (r = 0; r < h_screen_rows; r++) {
+	dirty_first[r] = 0;
+	dirty_last[r] = h_screen_cols - 1;
+    }
     os_erase_area(1, 1, h_screen_rows, h_screen_cols, -2);
-    memset(screen_changes, 0, screen_cells);
+    mark_all_unchanged();
+
+    /* Collect screen output until the next prompt.  */
+    batch_set_sink(dumb_render_batch);
+
+    /* Or don't even do that.  */
+    if (discard_screen) {
+	batch_discard(TRUE);
+	do_more_prompts = FALSE;
+    }
+
+    /* A program reading JSON has no use for more prompts.  */
+    if (json_mode) {
+	do_more_prompts = FALSE;
+	dumb_init_json();
+    }
 }
@@ -132,6 +132,7 @@ static void music_finished(void)
   if (!e_mod->active) return;
   e_mod->active = 0;
   e_mod->ended = 1;
+  tick_requested = 1;
   }
 
 // this may be called also via a Mix_Haltetc.
@@ -142,6 +143,7 @@ static void channel_finished(int channel)
   if (!e_sfx->active) return;
   e_sfx->active = 0;
   e_sfx->ended = 1;	// stopsample will take care of this...
+  tick_requested = 1;
   }
 
 static void stopsample()
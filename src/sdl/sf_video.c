@@ -395,6 +395,7 @@ static SDL_TimerID timerid = 0;
 static Uint32 mytimer( Uint32 inter, void *parm)
   {
   SFticked = true;
+  tick_requested = 1;
   return inter;
   }
 